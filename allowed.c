@@ -0,0 +1,452 @@
+/* PostgreSQL Extension WhiteList -- Dimitri Fontaine
+ *
+ * Author: Dimitri Fontaine <dimitri@2ndQuadrant.fr>
+ * Licence: PostgreSQL
+ * Copyright Dimitri Fontaine, 2011-2013
+ *
+ * For a description of the features see the README.md file from the same
+ * distribution.
+ */
+
+/*
+ * Whitelist kept in the extwlist.allowed table of the current database,
+ * when the pgextwlist extension is installed there.  We only trust the table
+ * that belongs to the extension: anyone with CREATE on the database could
+ * otherwise create an extwlist.allowed table of their own.
+ *
+ * Each backend loads the whole table in a hash table the first time it needs
+ * it, and keeps it until the table changes: a trigger on the table sends a
+ * relcache invalidation for it, which all the backends receive when the
+ * modifying transaction commits.  Creating or dropping the extension, and
+ * changes to the roles, invalidate the cache too.  When the table doesn't
+ * exist we remember that, until its schema or the table itself is created.
+ *
+ * Rows for a role apply to the roles that have its privileges, through
+ * membership.  Rather than checking memberships at each command, we compute
+ * the set of extensions allowed to the current user once, and keep it until
+ * the user or the table changes, or until role memberships change.
+ */
+
+#include "postgres.h"
+
+#include "pgextwlist.h"
+#include "allowed.h"
+
+#include "access/genam.h"
+#include "access/heapam.h"
+#include "access/htup_details.h"
+#include "catalog/dependency.h"
+#include "catalog/indexing.h"
+#include "catalog/namespace.h"
+#include "catalog/pg_class.h"
+#include "catalog/pg_extension.h"
+#include "catalog/pg_type.h"
+#include "commands/extension.h"
+#include "commands/trigger.h"
+#include "miscadmin.h"
+#include "utils/acl.h"
+#include "utils/builtins.h"
+#include "utils/fmgroids.h"
+#include "utils/hsearch.h"
+#include "utils/inval.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/syscache.h"
+#if PG_MAJOR_VERSION >= 1200
+#include "access/table.h"
+#else
+#define table_open(r, l) heap_open(r, l)
+#define table_close(r, l) heap_close(r, l)
+#endif
+#if PG_MAJOR_VERSION < 1100
+#define TupleDescAttr(tupdesc, i) ((tupdesc)->attrs[(i)])
+#endif
+
+#define ALLOWED_EXTENSION	"pgextwlist"
+#define ALLOWED_SCHEMA		"extwlist"
+#define ALLOWED_TABLE		"allowed"
+
+/* columns of extwlist.allowed */
+#define Natts_allowed				2
+#define Anum_allowed_extname		1
+#define Anum_allowed_rolname		2
+
+typedef struct AllowedKey
+{
+	NameData	extname;
+	Oid			roleid;			/* InvalidOid when allowed to every role */
+} AllowedKey;
+
+typedef struct AllowedEntry
+{
+	AllowedKey	key;			/* hash key, must be first */
+} AllowedEntry;
+
+typedef struct EffectiveEntry
+{
+	NameData	extname;		/* hash key, must be first */
+} EffectiveEntry;
+
+PG_FUNCTION_INFO_V1(extwlist_allowed_invalidate);
+
+static MemoryContext AllowedContext = NULL;
+static HTAB *allowed_hash = NULL;
+static bool allowed_valid = false;
+static bool allowed_invalidated = false;	/* while we load */
+
+/* the table, InvalidOid when pgextwlist is not installed here */
+static Oid	allowed_relid = InvalidOid;
+static bool allowed_relid_valid = false;
+
+/*
+ * Without the table, the syscache hash value of its name in the extension's
+ * schema, when that schema exists, so that we notice when it's created.
+ */
+static uint32 absent_hashvalue = 0;
+static bool absent_hashvalue_valid = false;
+
+/* the extensions allowed to effective_roleid */
+static MemoryContext EffectiveContext = NULL;
+static HTAB *effective_hash = NULL;
+static Oid	effective_roleid = InvalidOid;
+static bool effective_valid = false;
+static bool effective_invalidated = false;	/* while we build */
+
+static bool allowed_callbacks_registered = false;
+
+/*
+ * Forget about the table, and about what it allows to the current user.  The
+ * invalidated flags tell a load in progress, in which catalog accesses
+ * process invalidations, that its result is stale already.
+ */
+static void
+invalidate_allowed(void)
+{
+	allowed_valid = false;
+	allowed_invalidated = true;
+	allowed_relid_valid = false;
+	effective_valid = false;
+	effective_invalidated = true;
+}
+
+static void
+allowed_relcache_callback(Datum arg, Oid relid)
+{
+	if (relid == InvalidOid
+		|| (OidIsValid(allowed_relid) && relid == allowed_relid))
+		invalidate_allowed();
+}
+
+/*
+ * When we have no table, creating the extension in its existing schema adds
+ * a relation of that name there.  Creating the schema is noticed by the
+ * NAMESPACEOID callback instead.
+ */
+static void
+relname_syscache_callback(Datum arg, int cacheid, uint32 hashvalue)
+{
+	if (hashvalue == 0
+		|| (absent_hashvalue_valid && hashvalue == absent_hashvalue))
+		invalidate_allowed();
+}
+
+static void
+allowed_syscache_callback(Datum arg, int cacheid, uint32 hashvalue)
+{
+	invalidate_allowed();
+}
+
+static void
+membership_syscache_callback(Datum arg, int cacheid, uint32 hashvalue)
+{
+	effective_valid = false;
+	effective_invalidated = true;
+}
+
+/*
+ * The schema of given extension, get_extension_schema() is only exported
+ * from 16 on.
+ */
+static Oid
+extension_schema(Oid extoid)
+{
+#if PG_MAJOR_VERSION >= 1600
+	return get_extension_schema(extoid);
+#else
+	Relation	rel;
+	ScanKeyData entry[1];
+	SysScanDesc scan;
+	HeapTuple	tuple;
+	Oid			result = InvalidOid;
+
+	rel = table_open(ExtensionRelationId, AccessShareLock);
+
+	ScanKeyInit(&entry[0],
+#if PG_MAJOR_VERSION >= 1200
+				Anum_pg_extension_oid,
+#else
+				ObjectIdAttributeNumber,
+#endif
+				BTEqualStrategyNumber, F_OIDEQ,
+				ObjectIdGetDatum(extoid));
+
+	scan = systable_beginscan(rel, ExtensionOidIndexId, true,
+							  NULL, 1, entry);
+
+	if (HeapTupleIsValid(tuple = systable_getnext(scan)))
+		result = ((Form_pg_extension) GETSTRUCT(tuple))->extnamespace;
+
+	systable_endscan(scan);
+	table_close(rel, AccessShareLock);
+
+	return result;
+#endif
+}
+
+/*
+ * Find the table of the pgextwlist extension, if it is installed here.
+ */
+static Oid
+find_allowed_table(void)
+{
+	Oid			extoid = get_extension_oid(ALLOWED_EXTENSION, true);
+	Oid			nspid;
+	Oid			relid;
+
+	if (!OidIsValid(extoid))
+		return InvalidOid;
+
+	nspid = extension_schema(extoid);
+	if (!OidIsValid(nspid))
+		return InvalidOid;
+
+	relid = get_relname_relid(ALLOWED_TABLE, nspid);
+	if (!OidIsValid(relid))
+		return InvalidOid;
+
+	/* a table of the same name that is not a member of the extension */
+	if (getExtensionOfObject(RelationRelationId, relid) != extoid)
+		return InvalidOid;
+
+	return relid;
+}
+
+/*
+ * Load the table in our cache.
+ */
+static void
+load_allowed(void)
+{
+	HASHCTL		ctl;
+	Relation	rel;
+	SysScanDesc scan;
+	HeapTuple	tuple;
+
+	if (!allowed_callbacks_registered)
+	{
+		CacheRegisterRelcacheCallback(allowed_relcache_callback, (Datum) 0);
+		/* the extension's schema is created or dropped */
+		CacheRegisterSyscacheCallback(NAMESPACEOID,
+									  allowed_syscache_callback, (Datum) 0);
+		/* the extension's table is created */
+		CacheRegisterSyscacheCallback(RELNAMENSP,
+									  relname_syscache_callback, (Datum) 0);
+		/* role names resolve to other roles */
+		CacheRegisterSyscacheCallback(AUTHOID,
+									  allowed_syscache_callback, (Datum) 0);
+		/* role memberships change what the current user is allowed */
+		CacheRegisterSyscacheCallback(AUTHMEMBEROID,
+									  membership_syscache_callback, (Datum) 0);
+		allowed_callbacks_registered = true;
+	}
+
+	/*
+	 * We are only valid once we're done, so that an error leaves us invalid,
+	 * and when no invalidation arrived meanwhile.
+	 */
+	allowed_valid = false;
+	allowed_invalidated = false;
+	effective_valid = false;
+
+	if (AllowedContext == NULL)
+		AllowedContext = AllocSetContextCreate(TopMemoryContext,
+											   "pgextwlist allowed",
+											   ALLOCSET_SMALL_SIZES);
+	else
+		MemoryContextReset(AllowedContext);
+	allowed_hash = NULL;
+
+	if (!allowed_relid_valid)
+	{
+		Oid			nspid;
+
+		allowed_relid = find_allowed_table();
+
+		absent_hashvalue_valid = false;
+		if (!OidIsValid(allowed_relid)
+			&& OidIsValid(nspid = get_namespace_oid(ALLOWED_SCHEMA, true)))
+		{
+			absent_hashvalue = GetSysCacheHashValue2(RELNAMENSP,
+													 CStringGetDatum(ALLOWED_TABLE),
+													 ObjectIdGetDatum(nspid));
+			absent_hashvalue_valid = true;
+		}
+
+		allowed_relid_valid = !allowed_invalidated;
+	}
+
+	if (!OidIsValid(allowed_relid))
+	{
+		allowed_valid = !allowed_invalidated;
+		return;
+	}
+
+	MemSet(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(AllowedKey);
+	ctl.entrysize = sizeof(AllowedEntry);
+	ctl.hcxt = AllowedContext;
+
+	allowed_hash = hash_create("pgextwlist allowed", 64, &ctl,
+							   HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	rel = table_open(allowed_relid, AccessShareLock);
+
+	if (RelationGetDescr(rel)->natts != Natts_allowed
+		|| TupleDescAttr(RelationGetDescr(rel), Anum_allowed_extname - 1)->atttypid != NAMEOID
+		|| TupleDescAttr(RelationGetDescr(rel), Anum_allowed_rolname - 1)->atttypid != NAMEOID)
+		elog(ERROR, "unexpected definition of table \"%s.%s\"",
+			 ALLOWED_SCHEMA, ALLOWED_TABLE);
+
+	scan = systable_beginscan(rel, InvalidOid, false, NULL, 0, NULL);
+
+	while (HeapTupleIsValid(tuple = systable_getnext(scan)))
+	{
+		Datum		values[Natts_allowed];
+		bool		nulls[Natts_allowed];
+		AllowedKey	key;
+
+		heap_deform_tuple(tuple, RelationGetDescr(rel), values, nulls);
+
+		if (nulls[Anum_allowed_extname - 1])
+			continue;
+
+		MemSet(&key, 0, sizeof(key));
+		namestrcpy(&key.extname,
+				   NameStr(*DatumGetName(values[Anum_allowed_extname - 1])));
+
+		if (nulls[Anum_allowed_rolname - 1])
+			key.roleid = InvalidOid;
+		else
+		{
+			key.roleid = get_role_oid(NameStr(*DatumGetName(values[Anum_allowed_rolname - 1])),
+									  true);
+
+			/* rows for roles that don't exist don't allow anything */
+			if (!OidIsValid(key.roleid))
+				continue;
+		}
+
+		(void) hash_search(allowed_hash, &key, HASH_ENTER, NULL);
+	}
+
+	systable_endscan(scan);
+	table_close(rel, AccessShareLock);
+
+	allowed_valid = !allowed_invalidated;
+}
+
+/*
+ * Does the table have any rows? Used to skip everything when there's no
+ * whitelist at all.  This must be called in a transaction.
+ */
+bool
+allowed_table_is_empty(void)
+{
+	if (!allowed_valid)
+		load_allowed();
+
+	return allowed_hash == NULL || hash_get_num_entries(allowed_hash) == 0;
+}
+
+/*
+ * Compute the set of extensions allowed to given role, by rows for every
+ * role, for the role itself, and for the roles it has the privileges of.
+ */
+static void
+build_effective(Oid roleid)
+{
+	HASHCTL		ctl;
+	HASH_SEQ_STATUS hash_seq;
+	AllowedEntry *entry;
+
+	/* as in load_allowed() */
+	effective_valid = false;
+	effective_invalidated = false;
+	effective_roleid = roleid;
+
+	if (EffectiveContext == NULL)
+		EffectiveContext = AllocSetContextCreate(TopMemoryContext,
+												 "pgextwlist allowed roles",
+												 ALLOCSET_SMALL_SIZES);
+	else
+		MemoryContextReset(EffectiveContext);
+
+	MemSet(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(NameData);
+	ctl.entrysize = sizeof(EffectiveEntry);
+	ctl.hcxt = EffectiveContext;
+
+	effective_hash = hash_create("pgextwlist allowed roles", 64, &ctl,
+								 HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	/* has_privs_of_role() caches the memberships of the last role asked */
+	hash_seq_init(&hash_seq, allowed_hash);
+	while ((entry = hash_seq_search(&hash_seq)) != NULL)
+	{
+		if (!OidIsValid(entry->key.roleid)
+			|| entry->key.roleid == roleid
+			|| has_privs_of_role(roleid, entry->key.roleid))
+			(void) hash_search(effective_hash, &entry->key.extname,
+							   HASH_ENTER, NULL);
+	}
+
+	effective_valid = !effective_invalidated;
+}
+
+/*
+ * Is the extension allowed to given role by the table?
+ */
+bool
+allowed_table_contains(const char *extname, Oid roleid)
+{
+	NameData	key;
+
+	if (allowed_table_is_empty())
+		return false;
+
+	if (!effective_valid || effective_roleid != roleid)
+		build_effective(roleid);
+
+	MemSet(&key, 0, sizeof(key));
+	namestrcpy(&key, extname);
+
+	return hash_search(effective_hash, &key, HASH_FIND, NULL) != NULL;
+}
+
+/*
+ * Statement level trigger of extwlist.allowed, which tells all the backends
+ * to forget about the table contents once the transaction commits.
+ */
+Datum
+extwlist_allowed_invalidate(PG_FUNCTION_ARGS)
+{
+	TriggerData *trigdata = (TriggerData *) fcinfo->context;
+
+	if (!CALLED_AS_TRIGGER(fcinfo))
+		elog(ERROR, "extwlist_allowed_invalidate: not called by trigger manager");
+
+	CacheInvalidateRelcache(trigdata->tg_relation);
+
+	return PointerGetDatum(NULL);
+}
@@ -0,0 +1,17 @@
+/* PostgreSQL Extension WhiteList -- Dimitri Fontaine
+ *
+ * Author: Dimitri Fontaine <dimitri@2ndQuadrant.fr>
+ * Licence: PostgreSQL
+ * Copyright Dimitri Fontaine, 2011-2013
+ *
+ * For a description of the features see the README.md file from the same
+ * distribution.
+ */
+
+#ifndef __ALLOWED_H__
+#define __ALLOWED_H__
+
+bool allowed_table_is_empty(void);
+bool allowed_table_contains(const char *extname, Oid roleid);
+
+#endif
@@ -0,0 +1,248 @@
+/* PostgreSQL Extension WhiteList -- Dimitri Fontaine
+ *
+ * Author: Dimitri Fontaine <dimitri@2ndQuadrant.fr>
+ * Licence: PostgreSQL
+ * Copyright Dimitri Fontaine, 2011-2013
+ *
+ * For a description of the features see the README.md file from the same
+ * distribution.
+ */
+
+/*
+ * Audit trail of the commands we ran with superuser privileges.
+ *
+ * Each of them is recorded in a fixed-size ring buffer in shared memory,
+ * which only keeps the most recent entries.  Writers claim a slot with an
+ * atomic increment and never wait, and readers never block them: each slot
+ * has a sequence number that is odd while the slot is being written, and
+ * readers skip the slots that changed while they were copying them.
+ *
+ * The audit trail is only available when the module is loaded from
+ * shared_preload_libraries.
+ */
+
+#include "postgres.h"
+
+#include "pgextwlist.h"
+#include "audit.h"
+#include "utils.h"
+
+#include "commands/dbcommands.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "storage/shmem.h"
+#include "utils/builtins.h"
+#include "utils/timestamp.h"
+
+#if PG_MAJOR_VERSION >= 906
+#include "port/atomics.h"
+#endif
+
+/* how many entries we keep */
+#define EXTWLIST_AUDIT_ENTRIES	1024
+
+PG_FUNCTION_INFO_V1(extwlist_audit_log);
+
+#if PG_MAJOR_VERSION >= 906
+
+typedef struct AuditEntry
+{
+	pg_atomic_uint64 seq;		/* 2 * position + 1 while being written */
+	TimestampTz time;
+	Oid			roleid;
+	Oid			dbid;
+	NameData	extname;
+	int			action;			/* an ExtwlistAction */
+	int			nscripts;		/* custom scripts run */
+	uint64		duration;		/* in microseconds */
+	bool		success;
+} AuditEntry;
+
+typedef struct AuditRing
+{
+	pg_atomic_uint64 next;		/* next position to write at */
+	AuditEntry	entries[EXTWLIST_AUDIT_ENTRIES];
+} AuditRing;
+
+static AuditRing *audit_ring = NULL;
+
+Size
+extwlist_audit_shmem_size(void)
+{
+	return MAXALIGN(sizeof(AuditRing));
+}
+
+/*
+ * Called from our shmem_startup_hook, with AddinShmemInitLock held.
+ */
+void
+extwlist_audit_shmem_startup(void)
+{
+	bool		found;
+	int			i;
+
+	audit_ring = ShmemInitStruct("pgextwlist audit", sizeof(AuditRing), &found);
+
+	if (!found)
+	{
+		pg_atomic_init_u64(&audit_ring->next, 0);
+		for (i = 0; i < EXTWLIST_AUDIT_ENTRIES; i++)
+			pg_atomic_init_u64(&audit_ring->entries[i].seq, 0);
+	}
+}
+
+bool
+extwlist_audit_enabled(void)
+{
+	return audit_ring != NULL;
+}
+
+/*
+ * Record a privileged command.  This is called from error recovery too, so
+ * it must not fail.
+ */
+void
+extwlist_audit_record(const char *extname, ExtwlistAction action,
+					  Oid roleid, int nscripts, uint64 duration,
+					  bool success)
+{
+	uint64		pos;
+	AuditEntry *entry;
+
+	if (audit_ring == NULL || extname == NULL)
+		return;
+
+	pos = pg_atomic_fetch_add_u64(&audit_ring->next, 1);
+	entry = &audit_ring->entries[pos % EXTWLIST_AUDIT_ENTRIES];
+
+	pg_atomic_write_u64(&entry->seq, 2 * pos + 1);
+	pg_write_barrier();
+
+	entry->time = GetCurrentTimestamp();
+	entry->roleid = roleid;
+	entry->dbid = MyDatabaseId;
+	namestrcpy(&entry->extname, extname);
+	entry->action = action;
+	entry->nscripts = nscripts;
+	entry->duration = duration;
+	entry->success = success;
+
+	pg_write_barrier();
+	pg_atomic_write_u64(&entry->seq, 2 * pos + 2);
+}
+
+#else							/* PG_MAJOR_VERSION < 906 */
+
+Size
+extwlist_audit_shmem_size(void)
+{
+	return 0;
+}
+
+void
+extwlist_audit_shmem_startup(void)
+{
+}
+
+bool
+extwlist_audit_enabled(void)
+{
+	return false;
+}
+
+void
+extwlist_audit_record(const char *extname, ExtwlistAction action,
+					  Oid roleid, int nscripts, uint64 duration,
+					  bool success)
+{
+}
+
+#endif							/* PG_MAJOR_VERSION >= 906 */
+
+static Name
+make_name(const char *str)
+{
+	Name		name = (Name) palloc0(NAMEDATALEN);
+
+	namestrcpy(name, str);
+	return name;
+}
+
+/*
+ * extwlist.audit_log()
+ *
+ * Return the audit trail, oldest entries first.
+ */
+Datum
+extwlist_audit_log(PG_FUNCTION_ARGS)
+{
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+
+	if (!extwlist_audit_enabled())
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("pgextwlist must be loaded via shared_preload_libraries")));
+
+	tupstore = materialize_srf_result(fcinfo, &tupdesc);
+
+#if PG_MAJOR_VERSION >= 906
+	{
+		uint64		next = pg_atomic_read_u64(&audit_ring->next);
+		uint64		pos;
+
+		pos = next > EXTWLIST_AUDIT_ENTRIES ? next - EXTWLIST_AUDIT_ENTRIES : 0;
+
+		for (; pos < next; pos++)
+		{
+			AuditEntry *entry = &audit_ring->entries[pos % EXTWLIST_AUDIT_ENTRIES];
+			AuditEntry	copy;
+			uint64		seq;
+			Datum		values[8];
+			bool		nulls[8];
+			char	   *rolname;
+			char	   *datname;
+
+			/* skip slots being written, or already reused */
+			seq = pg_atomic_read_u64(&entry->seq);
+			if (seq != 2 * pos + 2)
+				continue;
+
+			pg_read_barrier();
+			memcpy(&copy, entry, sizeof(AuditEntry));
+			pg_read_barrier();
+
+			if (pg_atomic_read_u64(&entry->seq) != seq)
+				continue;
+
+			MemSet(nulls, 0, sizeof(nulls));
+
+			rolname = GetUserNameFromId(copy.roleid
+#if PG_MAJOR_VERSION >= 905
+										, true
+#endif
+				);
+			datname = get_database_name(copy.dbid);
+
+			values[0] = TimestampTzGetDatum(copy.time);
+			if (rolname)
+				values[1] = NameGetDatum(make_name(rolname));
+			else
+				nulls[1] = true;
+			if (datname)
+				values[2] = NameGetDatum(make_name(datname));
+			else
+				nulls[2] = true;
+			values[3] = NameGetDatum(&copy.extname);
+			values[4] = CStringGetTextDatum(extwlist_action_name(copy.action));
+			values[5] = Int32GetDatum(copy.nscripts);
+			values[6] = Float8GetDatum(copy.duration / 1000.0);
+			values[7] = BoolGetDatum(copy.success);
+
+			tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+		}
+	}
+#endif
+
+	return (Datum) 0;
+}
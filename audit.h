@@ -0,0 +1,25 @@
+/* PostgreSQL Extension WhiteList -- Dimitri Fontaine
+ *
+ * Author: Dimitri Fontaine <dimitri@2ndQuadrant.fr>
+ * Licence: PostgreSQL
+ * Copyright Dimitri Fontaine, 2011-2013
+ *
+ * For a description of the features see the README.md file from the same
+ * distribution.
+ */
+
+#ifndef __AUDIT_H__
+#define __AUDIT_H__
+
+#include "stats.h"
+
+Size extwlist_audit_shmem_size(void);
+void extwlist_audit_shmem_startup(void);
+
+bool extwlist_audit_enabled(void);
+
+void extwlist_audit_record(const char *extname, ExtwlistAction action,
+						   Oid roleid, int nscripts, uint64 duration,
+						   bool success);
+
+#endif
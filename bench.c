@@ -0,0 +1,452 @@
+/* PostgreSQL Extension WhiteList -- Dimitri Fontaine
+ *
+ * Author: Dimitri Fontaine <dimitri@2ndQuadrant.fr>
+ * Licence: PostgreSQL
+ * Copyright Dimitri Fontaine, 2011-2013
+ *
+ * For a description of the features see the README.md file from the same
+ * distribution.
+ */
+
+/*
+ * Microbenchmarks of the code paths run for each extension command, only
+ * built with make bench, see the pgextwlist_bench extension.
+ *
+ * Each function runs the code under test a given number of times against
+ * generated fixtures, and returns the time per operation in nanoseconds, and
+ * the memory allocated by one operation when we can tell (13 and later).
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <utime.h>
+#include "postgres.h"
+
+#include "pgextwlist.h"
+#include "scriptindex.h"
+#include "template.h"
+#include "utils.h"
+#include "whitelist.h"
+
+#include "access/htup_details.h"
+#include "funcapi.h"
+#include "lib/stringinfo.h"
+#include "miscadmin.h"
+#include "portability/instr_time.h"
+#include "storage/fd.h"
+#include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/memutils.h"
+
+PG_FUNCTION_INFO_V1(extwlist_bench_whitelist);
+PG_FUNCTION_INFO_V1(extwlist_bench_script_lookup);
+PG_FUNCTION_INFO_V1(extwlist_bench_fill_in_properties);
+PG_FUNCTION_INFO_V1(extwlist_bench_template);
+PG_FUNCTION_INFO_V1(extwlist_bench_grant_script);
+
+/*
+ * Running state of a benchmark: each operation runs in the bench memory
+ * context, which is reset in between.
+ */
+typedef struct Bench
+{
+	MemoryContext context;
+	MemoryContext oldcontext;
+	instr_time	start;
+	int			loops;
+	int64		bytes;			/* allocated by the first operation */
+} Bench;
+
+static void
+bench_start(Bench *bench, int loops)
+{
+	if (loops <= 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("number of loops must be positive")));
+
+	bench->context = AllocSetContextCreate(CurrentMemoryContext,
+										   "pgextwlist bench",
+										   ALLOCSET_DEFAULT_SIZES);
+	bench->loops = loops;
+	bench->bytes = -1;
+	bench->oldcontext = MemoryContextSwitchTo(bench->context);
+
+	INSTR_TIME_SET_CURRENT(bench->start);
+}
+
+static Size
+bench_used_memory(MemoryContext context)
+{
+#if PG_MAJOR_VERSION >= 1700
+	MemoryContextCounters consumed;
+
+	MemoryContextMemConsumed(context, &consumed);
+	return consumed.totalspace - consumed.freespace;
+#elif PG_MAJOR_VERSION >= 1300
+	return MemoryContextMemAllocated(context, true);
+#else
+	return 0;
+#endif
+}
+
+/*
+ * Called after each operation.  We only measure the memory used by the first
+ * one, not to slow down the others.
+ */
+static inline void
+bench_next(Bench *bench, int i)
+{
+	if (i == 0)
+	{
+		Size		before;
+
+		/* subtract what an empty context uses */
+		before = bench_used_memory(bench->context);
+		MemoryContextReset(bench->context);
+		bench->bytes = before - bench_used_memory(bench->context);
+	}
+	else
+		MemoryContextReset(bench->context);
+}
+
+static Datum
+bench_result(FunctionCallInfo fcinfo, Bench *bench)
+{
+	instr_time	duration;
+	TupleDesc	tupdesc;
+	Datum		values[2];
+	bool		nulls[2];
+
+	INSTR_TIME_SET_CURRENT(duration);
+	INSTR_TIME_SUBTRACT(duration, bench->start);
+
+	MemoryContextSwitchTo(bench->oldcontext);
+	MemoryContextDelete(bench->context);
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+	tupdesc = BlessTupleDesc(tupdesc);
+
+	MemSet(nulls, 0, sizeof(nulls));
+	values[0] = Float8GetDatum(INSTR_TIME_GET_DOUBLE(duration) * 1e9
+							   / bench->loops);
+#if PG_MAJOR_VERSION >= 1300
+	values[1] = Int64GetDatum(bench->bytes);
+#else
+	nulls[1] = true;
+#endif
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, values, nulls)));
+}
+
+static void
+bench_set_config(const char *name, const char *value)
+{
+	(void) set_config_option(name, value,
+							 PGC_SUSET, PGC_S_SESSION,
+							 GUC_ACTION_SAVE, true
+#if PG_MAJOR_VERSION >= 902
+							 , 0
+#endif
+#if PG_MAJOR_VERSION >= 905
+							 , false
+#endif
+		);
+}
+
+/*
+ * extwlist_bench.whitelist(names int, loops int)
+ *
+ * Look up names in a whitelist of given size, half of them are misses.
+ */
+Datum
+extwlist_bench_whitelist(PG_FUNCTION_ARGS)
+{
+	int			nnames = PG_GETARG_INT32(0);
+	int			loops = PG_GETARG_INT32(1);
+	int			save_nestlevel;
+	StringInfoData list;
+	char	  **names;
+	Bench		bench;
+	Datum		result;
+	int			i;
+
+	if (nnames <= 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("number of names must be positive")));
+
+	names = (char **) palloc(2 * nnames * sizeof(char *));
+	initStringInfo(&list);
+
+	for (i = 0; i < nnames; i++)
+	{
+		names[2 * i] = psprintf("bench_%d", i);
+		names[2 * i + 1] = psprintf("missing_%d", i);
+
+		if (i > 0)
+			appendStringInfoChar(&list, ',');
+		appendStringInfoString(&list, names[2 * i]);
+	}
+
+	save_nestlevel = NewGUCNestLevel();
+	bench_set_config("extwlist.extensions", list.data);
+
+	/* the first lookup builds the whitelist, don't account for it */
+	(void) extension_is_whitelisted(names[0]);
+
+	bench_start(&bench, loops);
+	for (i = 0; i < loops; i++)
+	{
+		(void) extension_is_whitelisted(names[i % (2 * nnames)]);
+		bench_next(&bench, i);
+	}
+	result = bench_result(fcinfo, &bench);
+
+	AtEOXact_GUC(true, save_nestlevel);
+
+	return result;
+}
+
+/*
+ * Make sure that the directory "path/extname" contains given number of
+ * custom scripts, creating the missing ones.
+ */
+static void
+make_script_fixtures(const char *path, const char *extname, int nfiles)
+{
+	char		dirname[MAXPGPATH];
+	char		filename[MAXPGPATH];
+	struct utimbuf times;
+	int			i;
+
+	snprintf(dirname, MAXPGPATH, "%s/%s", path, extname);
+
+	if (mkdir(path, S_IRWXU) < 0 && errno != EEXIST)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not create directory \"%s\": %m", path)));
+	if (mkdir(dirname, S_IRWXU) < 0 && errno != EEXIST)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not create directory \"%s\": %m", dirname)));
+
+	for (i = 0; i < nfiles; i++)
+	{
+		int			fd;
+
+		snprintf(filename, MAXPGPATH, "%s/before--1.%d.sql", dirname, i);
+
+		fd = OpenTransientFile(filename, O_WRONLY | O_CREAT | PG_BINARY
+#if PG_MAJOR_VERSION < 1100
+							   , S_IRUSR | S_IWUSR
+#endif
+			);
+		if (fd < 0)
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not create file \"%s\": %m", filename)));
+		CloseTransientFile(fd);
+	}
+
+	/*
+	 * Directories modified less than a second before indexing them are
+	 * indexed again at each lookup, see scriptindex.c: age them.
+	 */
+	times.actime = times.modtime = time(NULL) - 2;
+
+	(void) utime(dirname, &times);
+	(void) utime(path, &times);
+}
+
+/*
+ * extwlist_bench.script_lookup(path text, files int, loops int)
+ *
+ * Resolve custom script names against a custom_path tree, where the
+ * extension "bench_<files>" has given number of scripts, half of the lookups
+ * are misses.  The fixtures are left in place, to be reused.
+ */
+Datum
+extwlist_bench_script_lookup(PG_FUNCTION_ARGS)
+{
+	char	   *path = text_to_cstring(PG_GETARG_TEXT_PP(0));
+	int			nfiles = PG_GETARG_INT32(1);
+	int			loops = PG_GETARG_INT32(2);
+	int			save_nestlevel;
+	char	   *extname;
+	char		version[32];
+	Bench		bench;
+	Datum		result;
+	int			i;
+
+	if (nfiles <= 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("number of files must be positive")));
+
+	extname = psprintf("bench_%d", nfiles);
+	make_script_fixtures(path, extname, nfiles);
+
+	save_nestlevel = NewGUCNestLevel();
+	bench_set_config("extwlist.custom_path", path);
+
+	/* the first lookup builds the index, don't account for it */
+	(void) custom_script_exists(extname,
+								get_generic_custom_script_filename(extname,
+																   "create",
+																   "before"));
+
+	bench_start(&bench, loops);
+	for (i = 0; i < loops; i++)
+	{
+		char	   *filename;
+
+		snprintf(version, sizeof(version), "1.%d", i % (2 * nfiles));
+		filename = get_specific_custom_script_filename(extname, "before",
+													   NULL, version);
+		(void) custom_script_exists(extname, filename);
+		bench_next(&bench, i);
+	}
+	result = bench_result(fcinfo, &bench);
+
+	AtEOXact_GUC(true, save_nestlevel);
+
+	return result;
+}
+
+/*
+ * extwlist_bench.fill_in_properties(extname name, loops int)
+ *
+ * Find the default version and schema of given extension, which needs its
+ * control file.
+ */
+Datum
+extwlist_bench_fill_in_properties(PG_FUNCTION_ARGS)
+{
+	char	   *extname = NameStr(*PG_GETARG_NAME(0));
+	int			loops = PG_GETARG_INT32(1);
+	Bench		bench;
+	int			i;
+
+	bench_start(&bench, loops);
+	for (i = 0; i < loops; i++)
+	{
+		char	   *schema = NULL;
+		char	   *old_version = NULL;
+		char	   *new_version = NULL;
+
+		fill_in_extension_properties(extname, NIL,
+									 &schema, &old_version, &new_version);
+		bench_next(&bench, i);
+	}
+	return bench_result(fcinfo, &bench);
+}
+
+/*
+ * extwlist_bench.template(size int, loops int)
+ *
+ * Expand the placeholders of a script of given size in kB.
+ */
+Datum
+extwlist_bench_template(PG_FUNCTION_ARGS)
+{
+	int			size = PG_GETARG_INT32(0);
+	int			loops = PG_GETARG_INT32(1);
+	const char *values[TEMPLATE_NVALUES];
+	StringInfoData script;
+	Bench		bench;
+	int			i;
+
+	if (size <= 0 || size > MaxAllocSize / 1024 / 2)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("script size must be between 1 and %d kB",
+						(int) (MaxAllocSize / 1024 / 2))));
+
+	fill_in_template_values(values, "public", "1.0");
+
+	initStringInfo(&script);
+	while (script.len < size * 1024)
+		appendStringInfoString(&script,
+							   "GRANT SELECT ON @extschema@.bench TO @current_user@;\n"
+							   "COMMENT ON TABLE @extschema@.bench IS 'in @database@';\n");
+
+	bench_start(&bench, loops);
+	for (i = 0; i < loops; i++)
+	{
+		(void) expand_script_template(script.data, script.len, values);
+		bench_next(&bench, i);
+	}
+	return bench_result(fcinfo, &bench);
+}
+
+/*
+ * extwlist_bench.grant_script(path text, grants int, loops int, batch bool)
+ *
+ * Run a custom script of given number of GRANT and REVOKE statements on the
+ * extwlist_bench.grant_target table, with extwlist.batch_snapshots set to
+ * batch.  The script is left in place, to be reused.
+ */
+Datum
+extwlist_bench_grant_script(PG_FUNCTION_ARGS)
+{
+	char	   *path = text_to_cstring(PG_GETARG_TEXT_PP(0));
+	int			ngrants = PG_GETARG_INT32(1);
+	int			loops = PG_GETARG_INT32(2);
+	bool		batch = PG_GETARG_BOOL(3);
+	char		filename[MAXPGPATH];
+	int			save_nestlevel;
+	FILE	   *file;
+	Bench		bench;
+	Datum		result;
+	int			i;
+
+	if (ngrants <= 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("number of statements must be positive")));
+
+	if (mkdir(path, S_IRWXU) < 0 && errno != EEXIST)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not create directory \"%s\": %m", path)));
+
+	snprintf(filename, MAXPGPATH, "%s/grants--%d.sql", path, ngrants);
+
+	if ((file = AllocateFile(filename, "w")) == NULL)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not create file \"%s\": %m", filename)));
+
+	for (i = 0; i < ngrants; i++)
+		fprintf(file, i % 2 == 0
+				? "GRANT SELECT ON @extschema@.grant_target TO PUBLIC;\n"
+				: "REVOKE SELECT ON @extschema@.grant_target FROM PUBLIC;\n");
+
+	if (FreeFile(file) != 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not write file \"%s\": %m", filename)));
+
+	save_nestlevel = NewGUCNestLevel();
+	bench_set_config("extwlist.batch_snapshots", batch ? "on" : "off");
+
+	/* the first run parses and caches the script, don't account for it */
+	execute_custom_script(filename, "extwlist_bench", "1.0");
+
+	bench_start(&bench, loops);
+	for (i = 0; i < loops; i++)
+	{
+		execute_custom_script(filename, "extwlist_bench", "1.0");
+		bench_next(&bench, i);
+	}
+	result = bench_result(fcinfo, &bench);
+
+	AtEOXact_GUC(true, save_nestlevel);
+
+	return result;
+}
@@ -0,0 +1,38 @@
+-- Run the pgextwlist microbenchmarks, as a superuser, once built and
+-- installed with make bench:
+--
+--   psql -f bench/bench.sql [-v fixtures=/path/to/scratch/dir]
+--
+-- The custom_path fixtures are created in the fixtures directory, and left
+-- there to be reused by the next runs.
+
+\if :{?fixtures}
+\else
+\set fixtures /tmp/pgextwlist_bench
+\endif
+
+CREATE EXTENSION IF NOT EXISTS pgextwlist_bench;
+
+\echo extension_is_whitelisted()
+SELECT names, b.*
+  FROM unnest(array[10, 100, 1000, 10000]) AS names,
+       extwlist_bench.whitelist(names, 1000000) AS b;
+
+\echo custom script resolution
+SELECT files, b.*
+  FROM unnest(array[10, 1000, 10000, 100000]) AS files,
+       extwlist_bench.script_lookup(:'fixtures', files, 100000) AS b;
+
+\echo fill_in_extension_properties()
+SELECT b.* FROM extwlist_bench.fill_in_properties('plpgsql', 100000) AS b;
+
+\echo placeholder expansion
+SELECT size_kb, b.*
+  FROM (VALUES (1, 10000), (64, 1000), (1024, 100), (51200, 5))
+         AS t(size_kb, loops),
+       extwlist_bench.template(size_kb, loops) AS b;
+
+\echo custom script of GRANT statements, batch_snapshots off and on
+SELECT batch, b.*
+  FROM unnest(array[false, true]) AS batch,
+       extwlist_bench.grant_script(:'fixtures', 5000, 10, batch) AS b;
@@ -0,0 +1,9 @@
+-- One install/update/comment/drop cycle of whitelisted extensions, run by
+-- pgbench as a transaction of its own, see run.sh
+CREATE EXTENSION hstore;
+ALTER EXTENSION hstore UPDATE;
+COMMENT ON EXTENSION hstore IS 'pgextwlist load test';
+DROP EXTENSION hstore;
+CREATE EXTENSION refint;
+COMMENT ON EXTENSION refint IS 'pgextwlist load test';
+DROP EXTENSION refint;
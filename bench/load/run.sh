@@ -0,0 +1,89 @@
+#!/usr/bin/env bash
+#
+# Load test of the privileged extension commands, with pgbench.
+#
+# For each number of clients, run the cycle.sql script in as many databases
+# concurrently, one client per database as the extensions are the same, first
+# as a mere mortal going through the whitelist, then as a superuser for whom
+# the hook does nothing. Report the throughput and latencies of both, and the
+# overhead of the whitelist.
+#
+# Usage: run.sh [-c "1 2 4 8 16 32 64"] [-T seconds]
+#
+# The usual PGHOST, PGPORT and PGUSER environment variables apply, PGUSER
+# must be a superuser.
+
+set -e
+
+CLIENTS="1 2 4 8 16 32 64"
+DURATION=30
+HERE=$(cd "$(dirname "$0")" && pwd)
+
+while getopts "c:T:" opt
+do
+    case $opt in
+        c) CLIENTS=$OPTARG ;;
+        T) DURATION=$OPTARG ;;
+        *) echo "usage: $0 [-c clients] [-T seconds]" >&2; exit 1 ;;
+    esac
+done
+
+LOGDIR=$(mktemp -d -t pgextwlist_load.XXXXXX)
+trap 'rm -rf "$LOGDIR"' EXIT
+
+psql -X -q -v ON_ERROR_STOP=1 -d postgres -f "$HERE/setup.sql"
+
+# run_clients <clients> <role>
+# prints: tps p50_ms p99_ms
+run_clients()
+{
+    local clients=$1 role=$2 i
+
+    rm -f "$LOGDIR"/load.*
+
+    for i in $(seq 1 "$clients")
+    do
+        pgbench -n -c 1 -T "$DURATION" -f "$HERE/cycle.sql" \
+                -U "$role" -l --log-prefix="$LOGDIR/load.$i" \
+                "pgextwlist_load_$i" > /dev/null &
+    done
+    wait
+
+    # the third column of pgbench logs is the latency, in microseconds
+    cat "$LOGDIR"/load.* | awk '{ print $3 }' | sort -n \
+        | awk -v duration="$DURATION" '
+            { lat[NR] = $1 }
+            END {
+                if (NR == 0) { print "0 - -"; exit }
+                p50 = lat[int((NR - 1) * 0.50) + 1]
+                p99 = lat[int((NR - 1) * 0.99) + 1]
+                printf "%.1f %.2f %.2f\n", NR / duration, p50 / 1000, p99 / 1000
+            }'
+}
+
+printf "%7s  %10s %10s %10s  %10s %10s %10s  %8s\n" \
+       clients wl_tps wl_p50 wl_p99 su_tps su_p50 su_p99 overhead
+
+for clients in $CLIENTS
+do
+    for i in $(seq 1 "$clients")
+    do
+        db="pgextwlist_load_$i"
+        if ! psql -X -At -d postgres \
+             -c "SELECT 1 FROM pg_database WHERE datname = '$db'" | grep -q 1
+        then
+            createdb "$db"
+            psql -X -q -d "$db" -c "GRANT CREATE ON SCHEMA public TO pgextwlist_load"
+        fi
+    done
+
+    read -r wl_tps wl_p50 wl_p99 <<< "$(run_clients "$clients" pgextwlist_load)"
+    read -r su_tps su_p50 su_p99 <<< "$(run_clients "$clients" "${PGUSER:-$USER}")"
+
+    overhead=$(awk -v wl="$wl_tps" -v su="$su_tps" \
+                   'BEGIN { if (wl > 0) printf "%.1f%%", (su / wl - 1) * 100; else print "-" }')
+
+    printf "%7d  %10s %10s %10s  %10s %10s %10s  %8s\n" \
+           "$clients" "$wl_tps" "$wl_p50" "$wl_p99" \
+           "$su_tps" "$su_p50" "$su_p99" "$overhead"
+done
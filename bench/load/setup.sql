@@ -0,0 +1,7 @@
+-- Role used by the load test, to be run as a superuser, see run.sh
+SELECT 'CREATE ROLE pgextwlist_load LOGIN'
+ WHERE NOT EXISTS (SELECT 1 FROM pg_roles WHERE rolname = 'pgextwlist_load')
+\gexec
+
+ALTER ROLE pgextwlist_load SET session_preload_libraries = 'pgextwlist';
+ALTER ROLE pgextwlist_load SET extwlist.extensions = 'hstore,refint';
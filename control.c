@@ -0,0 +1,279 @@
+/* PostgreSQL Extension WhiteList -- Dimitri Fontaine
+ *
+ * Author: Dimitri Fontaine <dimitri@2ndQuadrant.fr>
+ * Licence: PostgreSQL
+ * Copyright Dimitri Fontaine, 2011-2013
+ *
+ * For a description of the features see the README.md file from the same
+ * distribution.
+ */
+
+/*
+ * Cache of the extensions' primary control files.
+ *
+ * CREATE EXTENSION and ALTER EXTENSION UPDATE commands often rely on the
+ * control file for the version and schema to use, and parsing it with the
+ * GUC file parser each time is wasteful.  Each backend keeps the parsed
+ * properties around, and checks with stat() that the file didn't change.
+ *
+ * Missing control files are cached too, so that repeated attempts at
+ * installing an extension that doesn't exist fail fast.
+ *
+ * When loaded from shared_preload_libraries, parsed control files are also
+ * shared between backends.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include "postgres.h"
+
+#include "pgextwlist.h"
+#include "utils.h"
+#include "control.h"
+#include "shmem.h"
+#include "trace.h"
+
+#include "miscadmin.h"
+#include "storage/fd.h"
+#include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+#if PG_MAJOR_VERSION >= 1000
+#include "utils/varlena.h"
+#endif
+
+#if PG_MAJOR_VERSION >= 1400
+#define CONTROL_HASH_FLAGS (HASH_ELEM | HASH_STRINGS | HASH_CONTEXT)
+#else
+#define CONTROL_HASH_FLAGS (HASH_ELEM | HASH_CONTEXT)
+#endif
+
+static MemoryContext ControlCacheContext = NULL;
+static HTAB *control_cache = NULL;
+static char control_sharepath[MAXPGPATH] = "";
+
+static void
+init_control_cache(void)
+{
+	HASHCTL		ctl;
+
+	ControlCacheContext = AllocSetContextCreate(TopMemoryContext,
+												"pgextwlist control cache",
+												ALLOCSET_SMALL_SIZES);
+
+	MemSet(&ctl, 0, sizeof(ctl));
+	ctl.keysize = NAMEDATALEN;
+	ctl.entrysize = sizeof(ExtensionControl);
+	ctl.hcxt = ControlCacheContext;
+
+	control_cache = hash_create("pgextwlist control cache", 32, &ctl,
+								CONTROL_HASH_FLAGS);
+
+	get_share_path(my_exec_path, control_sharepath);
+}
+
+static void
+report_missing_control_file(const char *filename, int save_errno)
+{
+	errno = save_errno;
+	ereport(ERROR,
+			(errcode_for_file_access(),
+			 errmsg("could not open extension control file \"%s\": %m",
+					filename)));
+}
+
+/*
+ * Parse the extension's primary control file into given entry, whose
+ * fields are allocated in the current memory context, along with the
+ * parser's own allocations.
+ *
+ * Control files are supposed to be very short, half a dozen lines,
+ * so we don't worry about memory allocation risks here.  Also we don't
+ * worry about what encoding it's in; all values are expected to be ASCII.
+ */
+static void
+parse_control_file(const char *filename, ExtensionControl *control)
+{
+	FILE	   *file;
+	ConfigVariable *item,
+		*head = NULL,
+		*tail = NULL;
+
+	if ((file = AllocateFile(filename, "r")) == NULL)
+		report_missing_control_file(filename, errno);
+
+	/*
+	 * Parse the file content, using GUC's file parsing code.  We need not
+	 * check the return value since any errors will be thrown at ERROR level.
+	 */
+	extwlist_wait_start(EXTWLIST_WAIT_CONTROL_READ);
+	(void) ParseConfigFp(file, filename, 0, ERROR, &head, &tail);
+	extwlist_wait_end();
+
+	FreeFile(file);
+
+	/*
+	 * Keep only the properties we use, let the core code complain about
+	 * anything else in there.
+	 */
+	for (item = head; item != NULL; item = item->next)
+	{
+		if (strcmp(item->name, "default_version") == 0)
+		{
+			control->default_version = pstrdup(item->value);
+		}
+		else if (strcmp(item->name, "schema") == 0)
+		{
+			control->schema = pstrdup(item->value);
+		}
+		else if (strcmp(item->name, "relocatable") == 0)
+		{
+			(void) parse_bool(item->value, &control->relocatable);
+		}
+		else if (strcmp(item->name, "requires") == 0)
+		{
+			/* Need a modifiable copy of string */
+			char	   *rawnames = pstrdup(item->value);
+
+			(void) SplitIdentifierString(rawnames, ',', &control->requires);
+		}
+	}
+
+	FreeConfigVariables(head);
+}
+
+static void
+free_control_fields(ExtensionControl *control)
+{
+	if (control->default_version)
+		pfree(control->default_version);
+	if (control->schema)
+		pfree(control->schema);
+	list_free_deep(control->requires);
+
+	control->default_version = NULL;
+	control->schema = NULL;
+	control->relocatable = false;
+	control->requires = NIL;
+}
+
+/*
+ * Copy the parsed properties into the cache's memory context.  Only the
+ * fields we use from the cache are set in the copy.
+ */
+static void
+copy_control_fields(const ExtensionControl *parsed, ExtensionControl *control)
+{
+	MemoryContext oldcontext = MemoryContextSwitchTo(ControlCacheContext);
+	ListCell   *lc;
+
+	control->default_version =
+		parsed->default_version ? pstrdup(parsed->default_version) : NULL;
+	control->schema = parsed->schema ? pstrdup(parsed->schema) : NULL;
+	control->relocatable = parsed->relocatable;
+	control->requires = NIL;
+
+	foreach(lc, parsed->requires)
+		control->requires = lappend(control->requires,
+									pstrdup((char *) lfirst(lc)));
+
+	MemoryContextSwitchTo(oldcontext);
+}
+
+/*
+ * Return the cached properties of given extension's control file, parsing
+ * it again when it changed.
+ */
+ExtensionControl *
+get_extension_control(const char *extname)
+{
+	char		filename[MAXPGPATH];
+	struct stat st;
+	ExtensionControl *control;
+	ExtensionControl parsed;
+	ExtensionControl cached;
+	MemoryContext parsecontext;
+	MemoryContext oldcontext;
+	bool		found;
+
+	if (control_cache == NULL)
+		init_control_cache();
+
+	snprintf(filename, MAXPGPATH, "%s/extension/%s.control",
+			 control_sharepath, extname);
+
+	control = (ExtensionControl *) hash_search(control_cache, extname,
+											   HASH_FIND, NULL);
+
+	if (stat(filename, &st) != 0)
+	{
+		int			save_errno = errno;
+
+		if (control == NULL)
+		{
+			control = (ExtensionControl *)
+				hash_search(control_cache, extname, HASH_ENTER, NULL);
+			control->default_version = NULL;
+			control->schema = NULL;
+			control->requires = NIL;
+		}
+		else
+			free_control_fields(control);
+
+		control->missing = true;
+
+		report_missing_control_file(filename, save_errno);
+	}
+
+	if (control != NULL
+		&& !control->missing
+		&& control->dev == st.st_dev
+		&& control->ino == st.st_ino
+		&& control->mtime == st.st_mtime
+		&& control->size == st.st_size)
+		return control;
+
+	/*
+	 * Parse the file in a temporary memory context, before touching the
+	 * cache entry, so that errors leave it untouched, and so that the
+	 * parser's allocations don't pile up in the cache.  An error releases the
+	 * temporary context along with its parent.  Another backend might have
+	 * parsed the file for us already, see shmem.c.
+	 */
+	MemSet(&parsed, 0, sizeof(parsed));
+
+	parsecontext = AllocSetContextCreate(CurrentMemoryContext,
+										 "pgextwlist control file",
+										 ALLOCSET_SMALL_SIZES);
+	oldcontext = MemoryContextSwitchTo(parsecontext);
+	found = shared_control_lookup(extname, &st, &parsed);
+	if (!found)
+		parse_control_file(filename, &parsed);
+	MemoryContextSwitchTo(oldcontext);
+
+	if (!found)
+		shared_control_store(extname, &st, &parsed);
+
+	copy_control_fields(&parsed, &cached);
+	MemoryContextDelete(parsecontext);
+
+	if (control)
+		free_control_fields(control);
+	else
+		control = (ExtensionControl *)
+			hash_search(control_cache, extname, HASH_ENTER, NULL);
+
+	control->missing = false;
+	control->dev = st.st_dev;
+	control->ino = st.st_ino;
+	control->mtime = st.st_mtime;
+	control->size = st.st_size;
+	control->default_version = cached.default_version;
+	control->schema = cached.schema;
+	control->relocatable = cached.relocatable;
+	control->requires = cached.requires;
+
+	return control;
+}
@@ -0,0 +1,38 @@
+/* PostgreSQL Extension WhiteList -- Dimitri Fontaine
+ *
+ * Author: Dimitri Fontaine <dimitri@2ndQuadrant.fr>
+ * Licence: PostgreSQL
+ * Copyright Dimitri Fontaine, 2011-2013
+ *
+ * For a description of the features see the README.md file from the same
+ * distribution.
+ */
+
+#ifndef __CONTROL_H__
+#define __CONTROL_H__
+
+#include <sys/types.h>
+#include <time.h>
+
+#include "nodes/pg_list.h"
+
+/*
+ * The parts of an extension's primary control file we are interested into.
+ */
+typedef struct ExtensionControl
+{
+	NameData	name;			/* hash key, must be first */
+	bool		missing;		/* control file does not exist */
+	dev_t		dev;
+	ino_t		ino;
+	time_t		mtime;
+	off_t		size;
+	char	   *default_version;
+	char	   *schema;
+	bool		relocatable;
+	List	   *requires;		/* names of required extensions */
+} ExtensionControl;
+
+ExtensionControl *get_extension_control(const char *extname);
+
+#endif
@@ -0,0 +1,169 @@
+/* PostgreSQL Extension WhiteList -- Dimitri Fontaine
+ *
+ * Author: Dimitri Fontaine <dimitri@2ndQuadrant.fr>
+ * Licence: PostgreSQL
+ * Copyright Dimitri Fontaine, 2011-2013
+ *
+ * For a description of the features see the README.md file from the same
+ * distribution.
+ */
+
+/*
+ * Rate limiting of the server log copy of denied extension commands.
+ *
+ * Applications retrying a CREATE EXTENSION that is not whitelisted in a
+ * tight loop would flood the server log with the same error.  The client
+ * still gets the error each time, but each backend only logs it once per
+ * extwlist.denial_log_interval for each role and extension.  How many
+ * messages were suppressed is logged along with the next one, or when the
+ * backend exits.
+ *
+ * The state is local to the backend, as we are called from error recovery,
+ * where we'd rather not take shared locks: a pool of connections retrying
+ * the same command logs once per interval and connection.
+ */
+
+#include "postgres.h"
+
+#include "pgextwlist.h"
+#include "denial.h"
+
+#include "miscadmin.h"
+#include "storage/ipc.h"
+#include "utils/builtins.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+#include "utils/timestamp.h"
+
+/* forget about everything past that many (role, extension) pairs */
+#define DENIAL_CACHE_SIZE	1024
+
+int			extwlist_denial_log_interval = 60;	/* seconds */
+
+typedef struct DenialKey
+{
+	Oid			roleid;
+	NameData	extname;
+} DenialKey;
+
+typedef struct DenialEntry
+{
+	DenialKey	key;			/* hash key, must be first */
+	NameData	rolname;		/* for logging outside of transactions */
+	TimestampTz last_logged;
+	int64		suppressed;
+} DenialEntry;
+
+static HTAB *denials = NULL;
+static bool denial_exit_callback_registered = false;
+
+static void
+log_suppressed_denials(DenialEntry *entry)
+{
+	if (entry->suppressed == 0)
+		return;
+
+	ereport(LOG,
+			(errmsg("suppressed " INT64_FORMAT " log messages about extension \"%s\" being denied to role \"%s\"",
+					entry->suppressed,
+					NameStr(entry->key.extname),
+					NameStr(entry->rolname))));
+
+	entry->suppressed = 0;
+}
+
+static void
+log_all_suppressed_denials(void)
+{
+	HASH_SEQ_STATUS hash_seq;
+	DenialEntry *entry;
+
+	if (denials == NULL)
+		return;
+
+	hash_seq_init(&hash_seq, denials);
+	while ((entry = hash_seq_search(&hash_seq)) != NULL)
+		log_suppressed_denials(entry);
+}
+
+static void
+denial_exit_callback(int code, Datum arg)
+{
+	log_all_suppressed_denials();
+}
+
+static void
+init_denials(void)
+{
+	HASHCTL		ctl;
+
+	MemSet(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(DenialKey);
+	ctl.entrysize = sizeof(DenialEntry);
+	ctl.hcxt = TopMemoryContext;
+
+	denials = hash_create("pgextwlist denials", 64, &ctl,
+						  HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	if (!denial_exit_callback_registered)
+	{
+		before_shmem_exit(denial_exit_callback, (Datum) 0);
+		denial_exit_callback_registered = true;
+	}
+}
+
+/*
+ * Account for a denied command on given extension by given role, and tell
+ * whether its error should go to the server log.
+ *
+ * This is called from error recovery, where we'd rather not access the
+ * catalogs, so the caller gives us the role name too.
+ */
+bool
+denial_should_be_logged(Oid roleid, const char *rolname, const char *extname)
+{
+	DenialKey	key;
+	DenialEntry *entry;
+	TimestampTz now;
+	bool		found;
+
+	if (extwlist_denial_log_interval <= 0)
+		return true;
+
+	if (denials != NULL && hash_get_num_entries(denials) >= DENIAL_CACHE_SIZE)
+	{
+		log_all_suppressed_denials();
+		hash_destroy(denials);
+		denials = NULL;
+	}
+
+	if (denials == NULL)
+		init_denials();
+
+	MemSet(&key, 0, sizeof(key));
+	key.roleid = roleid;
+	namestrcpy(&key.extname, extname);
+
+	entry = (DenialEntry *) hash_search(denials, &key, HASH_ENTER, &found);
+	now = GetCurrentTimestamp();
+
+	if (!found)
+	{
+		namestrcpy(&entry->rolname, rolname);
+		entry->last_logged = now;
+		entry->suppressed = 0;
+		return true;
+	}
+
+	if (!TimestampDifferenceExceeds(entry->last_logged, now,
+									extwlist_denial_log_interval * 1000))
+	{
+		entry->suppressed++;
+		return false;
+	}
+
+	log_suppressed_denials(entry);
+	entry->last_logged = now;
+
+	return true;
+}
@@ -0,0 +1,19 @@
+/* PostgreSQL Extension WhiteList -- Dimitri Fontaine
+ *
+ * Author: Dimitri Fontaine <dimitri@2ndQuadrant.fr>
+ * Licence: PostgreSQL
+ * Copyright Dimitri Fontaine, 2011-2013
+ *
+ * For a description of the features see the README.md file from the same
+ * distribution.
+ */
+
+#ifndef __DENIAL_H__
+#define __DENIAL_H__
+
+extern int	extwlist_denial_log_interval;
+
+bool denial_should_be_logged(Oid roleid, const char *rolname,
+							 const char *extname);
+
+#endif
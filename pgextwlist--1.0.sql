@@ -0,0 +1,90 @@
+/* pgextwlist--1.0.sql */
+
+-- complain if script is sourced in psql, rather than via CREATE EXTENSION
+\echo Use "CREATE EXTENSION pgextwlist" to load this file. \quit
+
+CREATE FUNCTION script_cache_stats(
+    OUT hits bigint,
+    OUT misses bigint,
+    OUT entries integer,
+    OUT bytes bigint)
+RETURNS record
+AS 'MODULE_PATHNAME', 'extwlist_script_cache_stats'
+LANGUAGE C STRICT VOLATILE;
+
+REVOKE ALL ON FUNCTION script_cache_stats() FROM PUBLIC;
+
+CREATE FUNCTION pg_stat_extwlist(
+    OUT extname name,
+    OUT action text,
+    OUT allowed bigint,
+    OUT denied bigint,
+    OUT lock_waits bigint,
+    OUT lock_wait_time double precision,
+    OUT before_time double precision,
+    OUT utility_time double precision,
+    OUT after_time double precision,
+    OUT histogram bigint[])
+RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'extwlist_pg_stat_extwlist'
+LANGUAGE C STRICT VOLATILE;
+
+REVOKE ALL ON FUNCTION pg_stat_extwlist() FROM PUBLIC;
+
+CREATE VIEW pg_stat_extwlist AS
+  SELECT * FROM pg_stat_extwlist();
+
+CREATE FUNCTION pg_stat_extwlist_reset()
+RETURNS void
+AS 'MODULE_PATHNAME', 'extwlist_pg_stat_extwlist_reset'
+LANGUAGE C STRICT VOLATILE;
+
+REVOKE ALL ON FUNCTION pg_stat_extwlist_reset() FROM PUBLIC;
+
+CREATE FUNCTION audit_log(
+    OUT "time" timestamptz,
+    OUT rolname name,
+    OUT datname name,
+    OUT extname name,
+    OUT action text,
+    OUT scripts integer,
+    OUT duration double precision,
+    OUT success boolean)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'extwlist_audit_log'
+LANGUAGE C STRICT VOLATILE;
+
+REVOKE ALL ON FUNCTION audit_log() FROM PUBLIC;
+
+CREATE TABLE allowed (
+    extname name NOT NULL,
+    rolname name,               -- NULL allows the extension to every role
+    UNIQUE (extname, rolname)
+);
+
+SELECT pg_catalog.pg_extension_config_dump('allowed', '');
+
+CREATE FUNCTION allowed_invalidate()
+RETURNS trigger
+AS 'MODULE_PATHNAME', 'extwlist_allowed_invalidate'
+LANGUAGE C;
+
+CREATE TRIGGER allowed_invalidate
+  AFTER INSERT OR UPDATE OR DELETE OR TRUNCATE ON allowed
+  FOR EACH STATEMENT EXECUTE PROCEDURE allowed_invalidate();
+
+CREATE FUNCTION install(
+    names text[],
+    schema text DEFAULT NULL,
+    OUT extname name,
+    OUT version text,
+    OUT before_time double precision,
+    OUT utility_time double precision,
+    OUT after_time double precision)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'extwlist_install'
+LANGUAGE C VOLATILE;
+
+-- install() is meant for the roles allowed to install extensions, the
+-- other functions are revoked from PUBLIC above
+GRANT USAGE ON SCHEMA extwlist TO PUBLIC;
@@ -13,9 +13,22 @@
 #include "postgres.h"
 
 #include "pgextwlist.h"
+#include "audit.h"
+#include "control.h"
+#include "denial.h"
+#include "scriptcache.h"
+#include "scriptindex.h"
+#include "shmem.h"
+#include "stats.h"
+#include "trace.h"
 #include "utils.h"
+#include "whitelist.h"
+#include "whitelistfile.h"
 
 #include "access/genam.h"
+#if PG_MAJOR_VERSION < 1200
+#include "access/hash.h"
+#endif
 #include "access/heapam.h"
 #include "access/xact.h"
 #include "catalog/dependency.h"
@@ -25,11 +38,16 @@
 #include "catalog/pg_authid.h"
 #include "catalog/pg_database.h"
 #include "catalog/pg_db_role_setting.h"
+#include "catalog/pg_type.h"
 #include "catalog/namespace.h"
 #include "commands/comment.h"
 #include "commands/dbcommands.h"
+#include "commands/extension.h"
 #include "commands/seclabel.h"
 #include "commands/user.h"
+#if PG_MAJOR_VERSION >= 1300
+#include "common/hashfn.h"
+#endif
 #if PG_MAJOR_VERSION >= 1000
 #include "common/md5.h"
 #else
@@ -37,13 +55,20 @@
 #endif
 #include "funcapi.h"
 #include "miscadmin.h"
+#include "nodes/makefuncs.h"
 #include "storage/lmgr.h"
+#include "storage/lock.h"
 #include "tcop/utility.h"
 #include "utils/acl.h"
+#include "utils/array.h"
 #include "utils/builtins.h"
 #include "utils/fmgroids.h"
+#if PG_MAJOR_VERSION == 1200
+#include "utils/hashutils.h"
+#endif
 #include "utils/inval.h"
 #include "utils/lsyscache.h"
+#include "utils/snapmgr.h"
 #include "utils/syscache.h"
 #include "utils/timestamp.h"
 #if PG_MAJOR_VERSION < 1200
@@ -61,11 +86,23 @@
  */
 PG_MODULE_MAGIC;
 
+PG_FUNCTION_INFO_V1(extwlist_install);
+
 char *extwlist_extensions = NULL;
 char *extwlist_custom_path = NULL;
+bool extwlist_batch_snapshots = true;
 
 static ProcessUtility_hook_type prev_ProcessUtility = NULL;
 
+/*
+ * The field4 of the advisory lock tags we use to serialize the privileged
+ * commands on a given extension, user advisory locks use 1 and 2.
+ */
+#define EXTWLIST_LOCKTAG_FIELD4		0x7877
+
+/* Current nesting depth of privileged utility statements (see below) */
+static int	extwlist_nesting_level = 0;
+
 void		_PG_init(void);
 void		_PG_fini(void);
 
@@ -131,6 +168,20 @@ void		_PG_fini(void);
                          "to install certain extensions. "              \
 						 "See: SHOW extwlist.extensions;")));
 
+/*
+ * A whitelisted extension, but not in this version: we can't let the core
+ * code run the command without privileges, as it would install any version
+ * of a trusted extension.
+ */
+#define EREPORT_VERSION_IS_NOT_WHITELISTED(version)						\
+        ereport(ERROR,                                                  \
+                (errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),               \
+                 errmsg("version \"%s\" of extension \"%s\" is not whitelisted", \
+						(version) ? (version) : "(none)", name),		\
+                 errhint("Your system administrator has allowed users " \
+                         "to install certain versions of this extension. " \
+						 "See: SHOW extwlist.extensions;")))
+
 
 static void extwlist_ProcessUtility(PROCESS_UTILITY_PROTO_ARGS);
 static void call_ProcessUtility(PROCESS_UTILITY_PROTO_ARGS,
@@ -139,6 +190,8 @@ static void call_ProcessUtility(PROCESS_UTILITY_PROTO_ARGS,
 								const char *old_version,
 								const char *new_version,
 								const char *action);
+static void call_denied_ProcessUtility(PROCESS_UTILITY_PROTO_ARGS,
+									   const char *name);
 static void call_RawProcessUtility(PROCESS_UTILITY_PROTO_ARGS);
 
 /*
@@ -158,8 +211,19 @@ _PG_init(void)
 							   "",
 							   PGC_SUSET,
 							   GUC_NOT_IN_SAMPLE,
+							   check_extwlist_extensions,
+							   assign_extwlist_extensions,
+							   NULL);
+
+	DefineCustomStringVariable("extwlist.extensions_file",
+							   "File listing more extensions that are whitelisted",
+							   "One per line, reloaded on SIGHUP when it changed.",
+							   &extwlist_extensions_file,
+							   "",
+							   PGC_SIGHUP,
+							   GUC_NOT_IN_SAMPLE,
 							   NULL,
-							   NULL,
+							   assign_extwlist_extensions_file,
 							   NULL);
 
 	DefineCustomStringVariable("extwlist.custom_path",
@@ -170,11 +234,50 @@ _PG_init(void)
 							   PGC_SUSET,
 							   GUC_NOT_IN_SAMPLE,
 							   NULL,
-							   NULL,
+							   assign_extwlist_custom_path,
 							   NULL);
 
+	DefineCustomBoolVariable("extwlist.batch_snapshots",
+							 "Share snapshots between catalog-only statements of custom scripts",
+							 "",
+							 &extwlist_batch_snapshots,
+							 true,
+							 PGC_SUSET,
+							 GUC_NOT_IN_SAMPLE,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomIntVariable("extwlist.denial_log_interval",
+							"Minimum time between logging the same denied extension command",
+							"Zero logs all of them.",
+							&extwlist_denial_log_interval,
+							60,
+							0,
+							INT_MAX / 1000,
+							PGC_SUSET,
+							GUC_NOT_IN_SAMPLE | GUC_UNIT_S,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("extwlist.script_cache_size",
+							"Memory used to cache the parsed custom scripts",
+							"Zero disables the cache.",
+							&extwlist_script_cache_size,
+							8192,
+							0,
+							MAX_KILOBYTES,
+							PGC_SUSET,
+							GUC_NOT_IN_SAMPLE | GUC_UNIT_KB,
+							NULL,
+							assign_extwlist_script_cache_size,
+							NULL);
+
 	EmitWarningsOnPlaceholders("extwlist");
 
+	extwlist_shmem_init();
+
 	prev_ProcessUtility = ProcessUtility_hook;
 	ProcessUtility_hook = extwlist_ProcessUtility;
 }
@@ -193,11 +296,16 @@ _PG_init(void)
  * - action is expected to be one of "create", "update", "comment", or "drop"
  * - when   is expected to be either "before" or "after"
  *
+ * The existence of those files is checked against an in-memory index of the
+ * custom_path directory, see scriptindex.c.
+ *
  * We don't validation the extension's name before building the scripts path
  * here because the extension name we are dealing with must have already been
  * added to the whitelist, which should be enough of a validation step.
+ *
+ * Returns whether a custom script has been run.
  */
-static void
+static bool
 call_extension_scripts(const char *extname,
 					   const char *schema,
 					   const char *action,
@@ -207,6 +315,7 @@ call_extension_scripts(const char *extname,
 {
 	char *specific_custom_script;
 	char *generic_custom_script;
+	bool found;
 
 	if (version)
 	{
@@ -216,10 +325,13 @@ call_extension_scripts(const char *extname,
 
 		elog(DEBUG1, "Considering custom script \"%s\"", specific_custom_script);
 
-		if (access(specific_custom_script, F_OK) == 0)
+		found = custom_script_exists(extname, specific_custom_script);
+		PGEXTWLIST_SCRIPT_LOOKUP(specific_custom_script, found);
+
+		if (found)
 		{
-			execute_custom_script(specific_custom_script, schema);
-			return; /* skip generic script */
+			execute_custom_script(specific_custom_script, schema, version);
+			return true; /* skip generic script */
 		}
 	}
 
@@ -228,36 +340,136 @@ call_extension_scripts(const char *extname,
 
 	elog(DEBUG1, "Considering custom script \"%s\"", generic_custom_script);
 
-	if (access(generic_custom_script, F_OK) == 0)
-		execute_custom_script(generic_custom_script, schema);
+	found = custom_script_exists(extname, generic_custom_script);
+	PGEXTWLIST_SCRIPT_LOOKUP(generic_custom_script, found);
+
+	if (found)
+		execute_custom_script(generic_custom_script, schema, version);
+
+	return found;
+}
+
+/*
+ * Return the extension name of an object from DROP EXTENSION's list.
+ *
+ * For deconstructing the object list into actual names, see the
+ * get_object_address_unqualified() function in
+ * src/backend/catalog/objectaddress.c
+ */
+static inline char *
+drop_extension_name(Node *object)
+{
+#if PG_MAJOR_VERSION < 1000
+	return strVal(linitial((List *) object));
+#elif PG_MAJOR_VERSION < 1500
+	return strVal((Value *) object);
+#else
+	return strVal(castNode(String, object));
+#endif
 }
 
+/*
+ * Serialize the privileged commands on the same extension in the current
+ * database, until the end of the transaction.
+ *
+ * Sessions racing to CREATE EXTENSION IF NOT EXISTS or ALTER EXTENSION
+ * UPDATE would otherwise all look at the catalogs before any of them
+ * commits, run their custom scripts, and then either pile up on the catalog
+ * rows and fail on unique violations, or run the update scripts for an old
+ * version.  Instead, they now wait for each other here, before looking up
+ * anything, and then see what the previous one did.
+ *
+ * The time spent waiting is accounted for in the statistics.  Returns
+ * whether we had to wait.
+ */
 static bool
-extension_is_whitelisted(const char *name)
+lock_extension_name(const char *name, ExtwlistAction action)
+{
+	LOCKTAG		tag;
+	instr_time	start;
+	instr_time	duration;
+
+	SET_LOCKTAG_ADVISORY(tag,
+						 MyDatabaseId,
+						 DatumGetUInt32(hash_any((const unsigned char *) name,
+												 strlen(name))),
+						 0,
+						 EXTWLIST_LOCKTAG_FIELD4);
+
+	if (LockAcquire(&tag, ExclusiveLock, false, true) != LOCKACQUIRE_NOT_AVAIL)
+		return false;
+
+	INSTR_TIME_SET_CURRENT(start);
+
+	(void) LockAcquire(&tag, ExclusiveLock, false, false);
+
+	INSTR_TIME_SET_CURRENT(duration);
+	INSTR_TIME_SUBTRACT(duration, start);
+
+	extwlist_stats_lock_wait(name, action, INSTR_TIME_GET_MICROSEC(duration));
+
+	/* make the catalog changes of the session we waited for visible */
+	AcceptInvalidationMessages();
+#if PG_MAJOR_VERSION >= 904
+	InvalidateCatalogSnapshot();
+#endif
+
+	return true;
+}
+
+static int
+compare_extension_names(const void *a, const void *b)
+{
+	return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+/*
+ * Lock the extensions of a DROP EXTENSION in name order, so that commands
+ * listing the same extensions in another order don't deadlock.
+ */
+static void
+lock_drop_extension_names(List *objects)
 {
-	bool        whitelisted = false;
-	char       *rawnames = pstrdup(extwlist_extensions);
-	List       *extensions;
+	char	  **names = (char **) palloc(list_length(objects) * sizeof(char *));
+	int			nnames = 0;
+	int			i;
 	ListCell   *lc;
 
-	if (!SplitIdentifierString(rawnames, ',', &extensions))
-	{
-		/* syntax error in extension name list */
-		ereport(ERROR,
-				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
-				 errmsg("parameter \"extwlist.extensions\" must be a list of extension names")));
-	}
-	foreach(lc, extensions)
+	foreach(lc, objects)
+		names[nnames++] = drop_extension_name(lfirst(lc));
+
+	qsort(names, nnames, sizeof(char *), compare_extension_names);
+
+	for (i = 0; i < nnames; i++)
+		(void) lock_extension_name(names[i], EXTWLIST_ACTION_DROP);
+
+	pfree(names);
+}
+
+/*
+ * Is the given utility statement one of those we are interested into?
+ *
+ * This is called for each and every utility statement, so it only looks at
+ * the parse tree.
+ */
+static inline bool
+is_extension_utility(Node *parsetree)
+{
+	switch (nodeTag(parsetree))
 	{
-		char *curext = (char *) lfirst(lc);
+		case T_CreateExtensionStmt:
+		case T_AlterExtensionStmt:
+			return true;
 
-		if (strcmp(name, curext) == 0)
-		{
-			whitelisted = true;
-			break;
-		}
+		case T_DropStmt:
+			return ((DropStmt *) parsetree)->removeType == OBJECT_EXTENSION;
+
+		case T_CommentStmt:
+			return ((CommentStmt *) parsetree)->objtype == OBJECT_EXTENSION;
+
+		default:
+			return false;
 	}
-	return whitelisted;
 }
 
 /*
@@ -270,37 +482,86 @@ extwlist_ProcessUtility(PROCESS_UTILITY_PROTO_ARGS)
 	char    *schema = NULL;
 	char    *old_version = NULL;
 	char    *new_version = NULL;
+	char	*denied = NULL;
+	bool	privileged = false;
 
 #if PG_MAJOR_VERSION >= 1000
 	Node       *parsetree = pstmt->utilityStmt;
 #endif
 
 	/*
+	 * When called from within a privileged command of ours, we are already
+	 * running as the bootstrap superuser: skip all the checks.
+	 */
+	if (extwlist_nesting_level > 0)
+	{
+		call_RawProcessUtility(PROCESS_UTILITY_ARGS);
+		return;
+	}
+
+	/*
+	 * Most utility statements have nothing to do with extensions, and we
+	 * don't want to slow them down: check the node tag first, and only then
+	 * consider the more expensive tests.
+	 *
 	 * Don't try to make life hard for our friendly superusers. Also, if
 	 * a valid transaction is not ongoing then return early.
 	 */
-	if (!IsTransactionState() || superuser())
+	if (!is_extension_utility(parsetree)
+		|| !IsTransactionState()
+		|| superuser()
+		|| whitelist_is_empty())
 	{
 		call_RawProcessUtility(PROCESS_UTILITY_ARGS);
 		return;
 	}
 
+	PGEXTWLIST_HOOK_START((int) nodeTag(parsetree));
+
 	switch (nodeTag(parsetree))
 	{
 		case T_CreateExtensionStmt:
 		{
 			CreateExtensionStmt *stmt = (CreateExtensionStmt *)parsetree;
 			name = stmt->extname;
+
+			/*
+			 * CREATE EXTENSION IF NOT EXISTS of an installed extension is a
+			 * no-op that applications run at each connection: leave it to
+			 * the core code, which only emits a notice, without reading the
+			 * control file or looking for custom scripts.
+			 */
+			if (stmt->if_not_exists && OidIsValid(get_extension_oid(name, true)))
+				break;
+
+			/* don't bother with the control file of denied extensions */
+			if (!extension_is_whitelisted(name))
+			{
+				extwlist_stats_denied(name, EXTWLIST_ACTION_CREATE);
+				denied = name;
+				break;
+			}
+
+			/* the session we waited for may have created it */
+			if (lock_extension_name(name, EXTWLIST_ACTION_CREATE)
+				&& stmt->if_not_exists
+				&& OidIsValid(get_extension_oid(name, true)))
+				break;
+
 			fill_in_extension_properties(name, stmt->options,
 										 &schema, &old_version, &new_version);
 
-			if (extension_is_whitelisted(name))
+			/* the version is only known now, it may be the default one */
+			if (!extension_version_is_whitelisted(name, new_version))
 			{
-				call_ProcessUtility(PROCESS_UTILITY_ARGS,
-									name, schema,
-									old_version, new_version, "create");
-				return;
+				extwlist_stats_denied(name, EXTWLIST_ACTION_CREATE);
+				EREPORT_VERSION_IS_NOT_WHITELISTED(new_version);
 			}
+
+			call_ProcessUtility(PROCESS_UTILITY_ARGS,
+								name, schema,
+								old_version, new_version, "create");
+			privileged = true;
 			break;
 		}
 
@@ -308,19 +569,32 @@ extwlist_ProcessUtility(PROCESS_UTILITY_PROTO_ARGS)
 		{
 			AlterExtensionStmt *stmt = (AlterExtensionStmt *)parsetree;
 			name = stmt->extname;
+
+			if (!extension_is_whitelisted(name))
+			{
+				extwlist_stats_denied(name, EXTWLIST_ACTION_UPDATE);
+				denied = name;
+				break;
+			}
+
+			(void) lock_extension_name(name, EXTWLIST_ACTION_UPDATE);
+
 			fill_in_extension_properties(name, stmt->options,
 										 &schema, &old_version, &new_version);
 
+			if (!extension_version_is_whitelisted(name, new_version))
+			{
+				extwlist_stats_denied(name, EXTWLIST_ACTION_UPDATE);
+				EREPORT_VERSION_IS_NOT_WHITELISTED(new_version);
+			}
+
 			/* fetch old_version from the catalogs, actually */
 			old_version = get_extension_current_version(name);
 
-			if (extension_is_whitelisted(name))
-			{
-				call_ProcessUtility(PROCESS_UTILITY_ARGS,
-									name, schema,
-									old_version, new_version, "update");
-				return;
-			}
+			call_ProcessUtility(PROCESS_UTILITY_ARGS,
+								name, schema,
+								old_version, new_version, "update");
+			privileged = true;
 			break;
 		}
 
@@ -333,23 +607,19 @@ extwlist_ProcessUtility(PROCESS_UTILITY_PROTO_ARGS)
 
 				foreach(lc, ((DropStmt *)parsetree)->objects)
 				{
-					/*
-					 * For deconstructing the object list into actual names,
-					 * see the get_object_address_unqualified() function in
-					 * src/backend/catalog/objectaddress.c
-					 */
 					bool whitelisted = false;
-					List *objname = lfirst(lc);
-#if PG_MAJOR_VERSION < 1000
-					name = strVal(linitial(objname));
-#elif PG_MAJOR_VERSION < 1500
-					name = strVal((Value *) objname);
-#else
-					name = strVal(castNode(String, objname));
-#endif
+
+					name = drop_extension_name(lfirst(lc));
 
 					whitelisted = extension_is_whitelisted(name);
 					all_in_whitelist = all_in_whitelist && whitelisted;
+
+					if (!whitelisted)
+					{
+						extwlist_stats_denied(name, EXTWLIST_ACTION_DROP);
+						if (denied == NULL)
+							denied = name;
+					}
 				}
 
 				/*
@@ -362,10 +632,12 @@ extwlist_ProcessUtility(PROCESS_UTILITY_PROTO_ARGS)
 				 */
 				if (all_in_whitelist)
 				{
+					lock_drop_extension_names(((DropStmt *)parsetree)->objects);
+
 					call_ProcessUtility(PROCESS_UTILITY_ARGS,
 										NULL, "", /* schema must not be NULL */
 										NULL, NULL, "drop");
-					return;
+					privileged = true;
 				}
 			}
 			break;
@@ -385,11 +657,16 @@ extwlist_ProcessUtility(PROCESS_UTILITY_PROTO_ARGS)
 
 				if (extension_is_whitelisted(name))
 				{
+					(void) lock_extension_name(name, EXTWLIST_ACTION_COMMENT);
+
 					call_ProcessUtility(PROCESS_UTILITY_ARGS,
 										name, "", /* schema must not be NULL */
 										NULL, NULL, "comment");
-					return;
+					privileged = true;
+					break;
 				}
+				extwlist_stats_denied(name, EXTWLIST_ACTION_COMMENT);
+				denied = name;
 			}
 			break;
 		}
@@ -400,10 +677,63 @@ extwlist_ProcessUtility(PROCESS_UTILITY_PROTO_ARGS)
 	}
 
 	/*
-	 * We can only fall here if we don't want to support the command, so pass
-	 * control over to the usual processing.
+	 * We can only fall here without privileges if we don't want to support
+	 * the command, so pass control over to the usual processing.
 	 */
-	call_RawProcessUtility(PROCESS_UTILITY_ARGS);
+	if (denied)
+		call_denied_ProcessUtility(PROCESS_UTILITY_ARGS, denied);
+	else if (!privileged)
+		call_RawProcessUtility(PROCESS_UTILITY_ARGS);
+
+	PGEXTWLIST_HOOK_DONE((int) nodeTag(parsetree));
+}
+
+/*
+ * Account for a privileged command in the statistics and the audit trail,
+ * once per extension for DROP EXTENSION, which accounts its whole duration to
+ * each of them.  The timings are NULL when the command failed.
+ */
+static void
+report_privileged_command(List *drop_objects,
+						  const char *name,
+						  const char *action,
+						  Oid roleid,
+						  int nscripts,
+						  instr_time start,
+						  const ExtwlistTimings *timings)
+{
+	ExtwlistAction stats_action;
+	instr_time	duration;
+	ListCell   *lc;
+
+	if (!extwlist_stats_enabled() && !extwlist_audit_enabled())
+		return;
+
+	stats_action = extwlist_action_from_name(action);
+
+	INSTR_TIME_SET_CURRENT(duration);
+	INSTR_TIME_SUBTRACT(duration, start);
+
+	if (drop_objects == NIL)
+	{
+		if (timings)
+			extwlist_stats_allowed(name, stats_action, timings);
+		extwlist_audit_record(name, stats_action, roleid, nscripts,
+							  INSTR_TIME_GET_MICROSEC(duration),
+							  timings != NULL);
+		return;
+	}
+
+	foreach(lc, drop_objects)
+	{
+		const char *extname = drop_extension_name(lfirst(lc));
+
+		if (timings)
+			extwlist_stats_allowed(extname, stats_action, timings);
+		extwlist_audit_record(extname, stats_action, roleid, nscripts,
+							  INSTR_TIME_GET_MICROSEC(duration),
+							  timings != NULL);
+	}
 }
 
 /*
@@ -420,6 +750,17 @@ call_ProcessUtility(PROCESS_UTILITY_PROTO_ARGS,
 {
 	Oid			save_userid;
 	int			save_sec_context;
+	List	   *drop_objects = NIL;
+	volatile int nscripts = 0;
+	ExtwlistTimings timings;
+	instr_time	command_start;
+	instr_time	start;
+
+	/* "drop extension" can list several extensions, walk them here */
+	if (strcmp(action, "drop") == 0)
+		drop_objects = ((DropStmt *) pstmt->utilityStmt)->objects;
+
+	PGEXTWLIST_PRIVILEGED_START(name, action);
 
 	GetUserIdAndSecContext(&save_userid, &save_sec_context);
 
@@ -428,64 +769,116 @@ call_ProcessUtility(PROCESS_UTILITY_PROTO_ARGS,
 						   | SECURITY_LOCAL_USERID_CHANGE
 						   | SECURITY_RESTRICTED_OPERATION);
 
-	if (action)
+	/*
+	 * Statements run from the extension's script or from our custom scripts
+	 * come back to our hook: track that we are already privileged so that
+	 * they are given directly to the previous hook.
+	 */
+	extwlist_nesting_level++;
+
+	INSTR_TIME_SET_CURRENT(command_start);
+
+	PG_TRY();
 	{
-		/* "drop extension" can list several extensions, walk them here */
-		if (strcmp(action, "drop") == 0)
-		{
-			Node   *parsetree = pstmt->utilityStmt;
-			ListCell *lc;
-			char   *name = NULL;
+		ListCell *lc;
 
-			foreach(lc, ((DropStmt *)parsetree)->objects)
-			{
-				List *objname = lfirst(lc);
-#if PG_MAJOR_VERSION < 1000
-				name = strVal(linitial(objname));
-#elif PG_MAJOR_VERSION < 1500
-				name = strVal((Value *) objname);
-#else
-				name = strVal(castNode(String, objname));
-#endif
-				call_extension_scripts(name, schema, action,
-									   "before", old_version, new_version);
-			}
+		start = command_start;
+
+		if (drop_objects != NIL)
+		{
+			foreach(lc, drop_objects)
+				nscripts += call_extension_scripts(drop_extension_name(lfirst(lc)),
+												   schema, action, "before",
+												   old_version, new_version);
 		}
 		else
-			call_extension_scripts(name, schema, action,
-								   "before", old_version, new_version);
-	}
+			nscripts += call_extension_scripts(name, schema, action, "before",
+											   old_version, new_version);
 
-	call_RawProcessUtility(PROCESS_UTILITY_ARGS);
+		INSTR_TIME_SET_CURRENT(timings.before);
+		INSTR_TIME_SUBTRACT(timings.before, start);
+		INSTR_TIME_SET_CURRENT(start);
 
-	if (action)
-	{
-		if (strcmp(action, "drop") == 0)
-		{
-			Node   *parsetree = pstmt->utilityStmt;
-			ListCell *lc;
-			char   *name = NULL;
+		call_RawProcessUtility(PROCESS_UTILITY_ARGS);
 
-			foreach(lc, ((DropStmt *)parsetree)->objects)
-			{
-				List *objname = lfirst(lc);
-#if PG_MAJOR_VERSION < 1000
-				name = strVal(linitial(objname));
-#elif PG_MAJOR_VERSION < 1500
-				name = strVal((Value *) objname);
-#else
-				name = strVal(castNode(String, objname));
-#endif
-				call_extension_scripts(name, schema, action,
-									   "after", old_version, new_version);
-			}
+		INSTR_TIME_SET_CURRENT(timings.utility);
+		INSTR_TIME_SUBTRACT(timings.utility, start);
+		INSTR_TIME_SET_CURRENT(start);
+
+		if (drop_objects != NIL)
+		{
+			foreach(lc, drop_objects)
+				nscripts += call_extension_scripts(drop_extension_name(lfirst(lc)),
+												   schema, action, "after",
+												   old_version, new_version);
 		}
 		else
-			call_extension_scripts(name, schema, action,
-								   "after", old_version, new_version);
+			nscripts += call_extension_scripts(name, schema, action, "after",
+											   old_version, new_version);
+
+		INSTR_TIME_SET_CURRENT(timings.after);
+		INSTR_TIME_SUBTRACT(timings.after, start);
 	}
+	PG_CATCH();
+	{
+		extwlist_nesting_level--;
+
+		report_privileged_command(drop_objects, name, action, save_userid,
+								  nscripts, command_start, NULL);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	extwlist_nesting_level--;
 
 	SetUserIdAndSecContext(save_userid, save_sec_context);
+
+	PGEXTWLIST_PRIVILEGED_DONE(name, action);
+
+	report_privileged_command(drop_objects, name, action, save_userid,
+							  nscripts, command_start, &timings);
+}
+
+/*
+ * Run a command on an extension that is not whitelisted without any
+ * privileges, so that the core code denies it when the user is not allowed
+ * to run it.  The client always gets the error, its server log copy is
+ * rate limited, see denial.c.
+ */
+static void
+call_denied_ProcessUtility(PROCESS_UTILITY_PROTO_ARGS, const char *name)
+{
+	MemoryContext oldcontext = CurrentMemoryContext;
+	Oid			roleid = GetUserId();
+	char	   *rolname = GetUserNameFromId(roleid
+#if PG_MAJOR_VERSION >= 905
+											, false
+#endif
+		);
+
+	PG_TRY();
+	{
+		call_RawProcessUtility(PROCESS_UTILITY_ARGS);
+	}
+	PG_CATCH();
+	{
+		ErrorData  *edata;
+
+		MemoryContextSwitchTo(oldcontext);
+		edata = CopyErrorData();
+
+		if (edata->elevel != ERROR
+			|| edata->sqlerrcode != ERRCODE_INSUFFICIENT_PRIVILEGE)
+			PG_RE_THROW();
+
+		FlushErrorState();
+
+		if (!denial_should_be_logged(roleid, rolname, name))
+			edata->output_to_server = false;
+
+		ReThrowError(edata);
+	}
+	PG_END_TRY();
 }
 
 static void
@@ -496,3 +889,343 @@ call_RawProcessUtility(PROCESS_UTILITY_PROTO_ARGS)
 	else
 		standard_ProcessUtility(PROCESS_UTILITY_ARGS);
 }
+
+/*
+ * An extension to install with extwlist.install()
+ */
+typedef enum InstallState
+{
+	INSTALL_UNSORTED,
+	INSTALL_SORTING,
+	INSTALL_SORTED
+} InstallState;
+
+typedef struct InstallItem
+{
+	char	   *name;
+	List	   *options;		/* of the CREATE EXTENSION statement */
+	char	   *schema;			/* for the custom scripts */
+	char	   *version;
+	bool		installed;		/* already there, skipped */
+	InstallState state;
+	int			nscripts;
+	instr_time	start;
+	ExtwlistTimings timings;
+} InstallItem;
+
+static int
+compare_install_items(const void *a, const void *b)
+{
+	return strcmp((*(InstallItem *const *) a)->name,
+				  (*(InstallItem *const *) b)->name);
+}
+
+/*
+ * Add an extension to the install order after the ones it requires, when
+ * they are to be installed too.  The others are left to the core code.
+ */
+static void
+sort_install_item(InstallItem *items, int nitems, InstallItem *item,
+				  InstallItem **sorted, int *nsorted)
+{
+	ExtensionControl *control;
+	ListCell   *lc;
+
+	if (item->state == INSTALL_SORTED)
+		return;
+
+	item->state = INSTALL_SORTING;
+
+	control = get_extension_control(item->name);
+
+	foreach(lc, control->requires)
+	{
+		const char *required = (const char *) lfirst(lc);
+		int			i;
+
+		for (i = 0; i < nitems; i++)
+			if (strcmp(items[i].name, required) == 0)
+				break;
+
+		if (i == nitems)
+			continue;
+
+		if (items[i].state == INSTALL_SORTING)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_RECURSION),
+					 errmsg("cyclic dependency detected between extensions \"%s\" and \"%s\"",
+							required, item->name)));
+
+		sort_install_item(items, nitems, &items[i], sorted, nsorted);
+	}
+
+	item->state = INSTALL_SORTED;
+	sorted[(*nsorted)++] = item;
+}
+
+/*
+ * Run CREATE EXTENSION through ProcessUtility(), as SPI does, so that event
+ * triggers and the other hooks see it.  Our own hook lets it through, as we
+ * are already privileged.
+ */
+static void
+run_create_extension(const InstallItem *item, const char *schema)
+{
+	CreateExtensionStmt *stmt = makeNode(CreateExtensionStmt);
+	char	   *query;
+#if PG_MAJOR_VERSION >= 1000
+	PlannedStmt *pstmt = makeNode(PlannedStmt);
+#endif
+
+	stmt->extname = item->name;
+	stmt->if_not_exists = false;
+	stmt->options = item->options;
+
+	if (schema)
+		query = psprintf("CREATE EXTENSION %s SCHEMA %s",
+						 quote_identifier(item->name),
+						 quote_identifier(schema));
+	else
+		query = psprintf("CREATE EXTENSION %s", quote_identifier(item->name));
+
+#if PG_MAJOR_VERSION >= 1000
+	pstmt->commandType = CMD_UTILITY;
+	pstmt->canSetTag = false;
+	pstmt->utilityStmt = (Node *) stmt;
+	pstmt->stmt_location = -1;
+	pstmt->stmt_len = 0;
+#endif
+
+#if PG_MAJOR_VERSION >= 1400
+	ProcessUtility(pstmt, query, false, PROCESS_UTILITY_QUERY,
+				   NULL, NULL, None_Receiver, NULL);
+#elif PG_MAJOR_VERSION >= 1000
+	ProcessUtility(pstmt, query, PROCESS_UTILITY_QUERY,
+				   NULL, NULL, None_Receiver, NULL);
+#elif PG_MAJOR_VERSION >= 903
+	ProcessUtility((Node *) stmt, query, PROCESS_UTILITY_QUERY,
+				   NULL, None_Receiver, NULL);
+#else
+	ProcessUtility((Node *) stmt, query, NULL, false, None_Receiver, NULL);
+#endif
+
+	/* the next extensions may require this one */
+	CommandCounterIncrement();
+}
+
+/*
+ * extwlist.install(names text[], schema text)
+ *
+ * Install a set of whitelisted extensions, in dependency order, and return
+ * the time spent in each phase of each install, in milliseconds.
+ *
+ * This does what a CREATE EXTENSION per extension would do, but checks the
+ * whole set against the whitelist before installing anything, and switches
+ * to the bootstrap superuser only once.  Extensions that are already
+ * installed are skipped.
+ */
+Datum
+extwlist_install(PG_FUNCTION_ARGS)
+{
+	char	   *schema = PG_ARGISNULL(1) ? NULL : text_to_cstring(PG_GETARG_TEXT_PP(1));
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	Datum	   *elems;
+	bool	   *elemnulls;
+	int			nelems;
+	InstallItem *items;
+	InstallItem **sorted;
+	int			nitems = 0;
+	int			nsorted = 0;
+	Oid			save_userid;
+	int			save_sec_context;
+	InstallItem *volatile current = NULL;
+	int			i;
+
+	tupstore = materialize_srf_result(fcinfo, &tupdesc);
+
+	if (PG_ARGISNULL(0))
+		return (Datum) 0;
+
+	deconstruct_array(PG_GETARG_ARRAYTYPE_P(0), TEXTOID, -1, false, 'i',
+					  &elems, &elemnulls, &nelems);
+
+	items = (InstallItem *) palloc0(Max(nelems, 1) * sizeof(InstallItem));
+	sorted = (InstallItem **) palloc(Max(nelems, 1) * sizeof(InstallItem *));
+
+	for (i = 0; i < nelems; i++)
+	{
+		char	   *name;
+		int			j;
+
+		if (elemnulls[i])
+			ereport(ERROR,
+					(errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+					 errmsg("extension names must not be null")));
+
+		name = text_to_cstring(DatumGetTextPP(elems[i]));
+
+		for (j = 0; j < nitems; j++)
+			if (strcmp(items[j].name, name) == 0)
+				break;
+
+		if (j == nitems)
+			items[nitems++].name = name;
+	}
+
+	/* don't bother with the control files when any of them is denied */
+	if (!superuser())
+	{
+		for (i = 0; i < nitems; i++)
+		{
+			const char *name = items[i].name;
+
+			if (!extension_is_whitelisted(name))
+			{
+				extwlist_stats_denied(name, EXTWLIST_ACTION_CREATE);
+				EREPORT_EXTENSION_IS_NOT_WHITELISTED("Installing");
+			}
+		}
+	}
+
+	/* lock them in a fixed order, not to deadlock with another install */
+	for (i = 0; i < nitems; i++)
+		sorted[i] = &items[i];
+	qsort(sorted, nitems, sizeof(InstallItem *), compare_install_items);
+
+	for (i = 0; i < nitems; i++)
+		(void) lock_extension_name(sorted[i]->name, EXTWLIST_ACTION_CREATE);
+
+	for (i = 0; i < nitems; i++)
+	{
+		InstallItem *item = &items[i];
+		const char *name = item->name;
+		char	   *old_version = NULL;
+
+		if (OidIsValid(get_extension_oid(name, true)))
+		{
+			ereport(NOTICE,
+					(errcode(ERRCODE_DUPLICATE_OBJECT),
+					 errmsg("extension \"%s\" already exists, skipping",
+							name)));
+			item->installed = true;
+			continue;
+		}
+
+		if (schema)
+			item->options = list_make1(makeDefElem("schema",
+												   (Node *) makeString(pstrdup(schema))
+#if PG_MAJOR_VERSION >= 1000
+												   , -1
+#endif
+									   ));
+
+		fill_in_extension_properties(name, item->options,
+									 &item->schema, &old_version,
+									 &item->version);
+
+		if (!superuser() && !extension_version_is_whitelisted(name, item->version))
+		{
+			extwlist_stats_denied(name, EXTWLIST_ACTION_CREATE);
+			EREPORT_VERSION_IS_NOT_WHITELISTED(item->version);
+		}
+	}
+
+	for (i = 0; i < nitems; i++)
+		sort_install_item(items, nitems, &items[i], sorted, &nsorted);
+
+	/* as in call_ProcessUtility(), but once for all the extensions */
+	GetUserIdAndSecContext(&save_userid, &save_sec_context);
+
+	SetUserIdAndSecContext(BOOTSTRAP_SUPERUSERID,
+						   save_sec_context
+						   | SECURITY_LOCAL_USERID_CHANGE
+						   | SECURITY_RESTRICTED_OPERATION);
+
+	extwlist_nesting_level++;
+
+	PG_TRY();
+	{
+		for (i = 0; i < nsorted; i++)
+		{
+			InstallItem *item = sorted[i];
+			instr_time	start;
+
+			if (item->installed)
+				continue;
+
+			current = item;
+
+			PGEXTWLIST_PRIVILEGED_START(item->name, "create");
+
+			INSTR_TIME_SET_CURRENT(item->start);
+			start = item->start;
+
+			item->nscripts += call_extension_scripts(item->name, item->schema,
+													 "create", "before",
+													 NULL, item->version);
+
+			INSTR_TIME_SET_CURRENT(item->timings.before);
+			INSTR_TIME_SUBTRACT(item->timings.before, start);
+			INSTR_TIME_SET_CURRENT(start);
+
+			run_create_extension(item, schema);
+
+			INSTR_TIME_SET_CURRENT(item->timings.utility);
+			INSTR_TIME_SUBTRACT(item->timings.utility, start);
+			INSTR_TIME_SET_CURRENT(start);
+
+			item->nscripts += call_extension_scripts(item->name, item->schema,
+													 "create", "after",
+													 NULL, item->version);
+
+			INSTR_TIME_SET_CURRENT(item->timings.after);
+			INSTR_TIME_SUBTRACT(item->timings.after, start);
+
+			PGEXTWLIST_PRIVILEGED_DONE(item->name, "create");
+		}
+	}
+	PG_CATCH();
+	{
+		extwlist_nesting_level--;
+
+		if (current)
+			report_privileged_command(NIL, current->name, "create",
+									  save_userid, current->nscripts,
+									  current->start, NULL);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	extwlist_nesting_level--;
+
+	SetUserIdAndSecContext(save_userid, save_sec_context);
+
+	for (i = 0; i < nsorted; i++)
+	{
+		InstallItem *item = sorted[i];
+		Datum		values[5];
+		bool		nulls[5];
+
+		if (item->installed)
+			continue;
+
+		report_privileged_command(NIL, item->name, "create", save_userid,
+								  item->nscripts, item->start, &item->timings);
+
+		MemSet(nulls, 0, sizeof(nulls));
+
+		values[0] = DirectFunctionCall1(namein, CStringGetDatum(item->name));
+		if (item->version)
+			values[1] = CStringGetTextDatum(item->version);
+		else
+			nulls[1] = true;
+		values[2] = Float8GetDatum(INSTR_TIME_GET_MILLISEC(item->timings.before));
+		values[3] = Float8GetDatum(INSTR_TIME_GET_MILLISEC(item->timings.utility));
+		values[4] = Float8GetDatum(INSTR_TIME_GET_MILLISEC(item->timings.after));
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	return (Datum) 0;
+}
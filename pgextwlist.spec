@@ -34,6 +34,7 @@ rm -rf %{buildroot}
 %defattr(-,root,root,-)
 %doc README.md
 %{?pkglibdir}%{!?pkglibdir:%{_libdir}/pgsql}/
+%{?pkgsharedir}%{!?pkgsharedir:%{_datadir}/pgsql}/extension/pgextwlist*
 
 %changelog
 * Sun Oct 15 2017 Christoph Berg <myon@debian.org> - 1.6-0
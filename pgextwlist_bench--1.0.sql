@@ -0,0 +1,60 @@
+/* pgextwlist_bench--1.0.sql */
+
+-- complain if script is sourced in psql, rather than via CREATE EXTENSION
+\echo Use "CREATE EXTENSION pgextwlist_bench" to load this file. \quit
+
+CREATE FUNCTION whitelist(
+    names integer,
+    loops integer,
+    OUT ns_per_op double precision,
+    OUT bytes_per_op bigint)
+RETURNS record
+AS 'MODULE_PATHNAME', 'extwlist_bench_whitelist'
+LANGUAGE C STRICT VOLATILE;
+
+CREATE FUNCTION script_lookup(
+    path text,
+    files integer,
+    loops integer,
+    OUT ns_per_op double precision,
+    OUT bytes_per_op bigint)
+RETURNS record
+AS 'MODULE_PATHNAME', 'extwlist_bench_script_lookup'
+LANGUAGE C STRICT VOLATILE;
+
+CREATE FUNCTION fill_in_properties(
+    extname name,
+    loops integer,
+    OUT ns_per_op double precision,
+    OUT bytes_per_op bigint)
+RETURNS record
+AS 'MODULE_PATHNAME', 'extwlist_bench_fill_in_properties'
+LANGUAGE C STRICT VOLATILE;
+
+CREATE FUNCTION template(
+    size integer,
+    loops integer,
+    OUT ns_per_op double precision,
+    OUT bytes_per_op bigint)
+RETURNS record
+AS 'MODULE_PATHNAME', 'extwlist_bench_template'
+LANGUAGE C STRICT VOLATILE;
+
+CREATE TABLE grant_target (id integer);
+
+CREATE FUNCTION grant_script(
+    path text,
+    grants integer,
+    loops integer,
+    batch boolean,
+    OUT ns_per_op double precision,
+    OUT bytes_per_op bigint)
+RETURNS record
+AS 'MODULE_PATHNAME', 'extwlist_bench_grant_script'
+LANGUAGE C STRICT VOLATILE;
+
+REVOKE ALL ON FUNCTION whitelist(integer, integer) FROM PUBLIC;
+REVOKE ALL ON FUNCTION script_lookup(text, integer, integer) FROM PUBLIC;
+REVOKE ALL ON FUNCTION fill_in_properties(name, integer) FROM PUBLIC;
+REVOKE ALL ON FUNCTION template(integer, integer) FROM PUBLIC;
+REVOKE ALL ON FUNCTION grant_script(text, integer, integer, boolean) FROM PUBLIC;
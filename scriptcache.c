@@ -0,0 +1,358 @@
+/* PostgreSQL Extension WhiteList -- Dimitri Fontaine
+ *
+ * Author: Dimitri Fontaine <dimitri@2ndQuadrant.fr>
+ * Licence: PostgreSQL
+ * Copyright Dimitri Fontaine, 2011-2013
+ *
+ * For a description of the features see the README.md file from the same
+ * distribution.
+ */
+
+/*
+ * Cache of the custom scripts, once loaded, substituted and parsed.
+ *
+ * The same custom scripts are run again and again, so we keep the script
+ * text and its raw parse tree list around, in a size-bounded LRU cache.
+ * Entries are keyed by the file name and the values used in the templating
+ * of the script, and are only used when the file still has the same inode,
+ * modification and change times and size.  Times have a one second
+ * resolution, which a quick rewrite of the file wouldn't change, so we also
+ * compare their nanoseconds where the platform has them.
+ *
+ * Raw parse trees are not tied to the catalogs, so they never need to be
+ * invalidated otherwise.  Parse analysis might scribble on them though, so
+ * we always give a copy of the cached trees to the caller.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "postgres.h"
+
+#include "pgextwlist.h"
+#include "utils.h"
+#include "scriptcache.h"
+
+#include "access/htup_details.h"
+#if PG_MAJOR_VERSION >= 1300
+#include "common/hashfn.h"
+#elif PG_MAJOR_VERSION >= 1200
+#include "utils/hashutils.h"
+#else
+#include "access/hash.h"
+#endif
+#include "funcapi.h"
+#include "lib/ilist.h"
+#include "lib/stringinfo.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+
+int			extwlist_script_cache_size = 8192;	/* kB */
+
+#if defined(__APPLE__)
+#define ST_MTIME_NSEC(st)	((st).st_mtimespec.tv_nsec)
+#define ST_CTIME_NSEC(st)	((st).st_ctimespec.tv_nsec)
+#elif defined(WIN32)
+#define ST_MTIME_NSEC(st)	0
+#define ST_CTIME_NSEC(st)	0
+#else
+#define ST_MTIME_NSEC(st)	((st).st_mtim.tv_nsec)
+#define ST_CTIME_NSEC(st)	((st).st_ctim.tv_nsec)
+#endif
+
+/* parse trees typically take a few times the size of the script text */
+#define SCRIPT_CACHE_TREE_FACTOR 4
+
+typedef struct ScriptCacheKey
+{
+	char		filename[MAXPGPATH];
+	uint32		values_hash;
+} ScriptCacheKey;
+
+typedef struct ScriptCacheEntry
+{
+	ScriptCacheKey key;			/* hash key, must be first */
+	ScriptFileId fileid;
+	char	   *values;			/* NUL separated templating values */
+	int			values_len;
+	char	   *sql;
+	List	   *raw_parsetree_list;
+	MemoryContext context;		/* holds all of the above */
+	Size		size;
+	dlist_node	lru_node;		/* most recently used first */
+} ScriptCacheEntry;
+
+static MemoryContext ScriptCacheContext = NULL;
+static HTAB *script_cache = NULL;
+static dlist_head script_cache_lru = DLIST_STATIC_INIT(script_cache_lru);
+static Size script_cache_used = 0;
+
+static int64 script_cache_hits = 0;
+static int64 script_cache_misses = 0;
+
+PG_FUNCTION_INFO_V1(extwlist_script_cache_stats);
+
+static void
+init_script_cache(void)
+{
+	HASHCTL		ctl;
+
+	ScriptCacheContext = AllocSetContextCreate(TopMemoryContext,
+											   "pgextwlist script cache",
+											   ALLOCSET_SMALL_SIZES);
+
+	MemSet(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(ScriptCacheKey);
+	ctl.entrysize = sizeof(ScriptCacheEntry);
+	ctl.hcxt = ScriptCacheContext;
+
+	script_cache = hash_create("pgextwlist script cache", 64, &ctl,
+							   HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+}
+
+static void
+remove_script_cache_entry(ScriptCacheEntry *entry)
+{
+	script_cache_used -= entry->size;
+	dlist_delete(&entry->lru_node);
+	MemoryContextDelete(entry->context);
+	(void) hash_search(script_cache, &entry->key, HASH_REMOVE, NULL);
+}
+
+/*
+ * Evict least recently used entries until we fit in given size.
+ */
+static void
+evict_script_cache(Size limit)
+{
+	while (script_cache_used > limit && !dlist_is_empty(&script_cache_lru))
+	{
+		ScriptCacheEntry *entry =
+			dlist_tail_element(ScriptCacheEntry, lru_node, &script_cache_lru);
+
+		remove_script_cache_entry(entry);
+	}
+}
+
+/*
+ * GUC assign_hook for extwlist.script_cache_size
+ */
+void
+assign_extwlist_script_cache_size(int newval, void *extra)
+{
+	if (script_cache != NULL)
+		evict_script_cache((Size) newval * 1024);
+}
+
+/*
+ * Build the cache key for given script and templating values.
+ */
+static void
+make_script_cache_key(ScriptCacheKey *key, StringInfo buf,
+					  const char *filename, const char **values, int nvalues)
+{
+	int			i;
+
+	for (i = 0; i < nvalues; i++)
+	{
+		if (values[i])
+			appendStringInfoString(buf, values[i]);
+		appendStringInfoChar(buf, '\0');
+	}
+
+	MemSet(key, 0, sizeof(ScriptCacheKey));
+	strlcpy(key->filename, filename, MAXPGPATH);
+	key->values_hash = DatumGetUInt32(hash_any((unsigned char *) buf->data,
+											   buf->len));
+}
+
+/*
+ * Would a script of given length fit in the cache once parsed?
+ */
+bool
+script_cache_would_keep(size_t len)
+{
+	return extwlist_script_cache_size > 0
+		&& len * SCRIPT_CACHE_TREE_FACTOR
+		<= (Size) extwlist_script_cache_size * 1024;
+}
+
+/*
+ * Look up given script in the cache. On success, return a copy of the
+ * cached script text and raw parse tree list in the current memory context.
+ *
+ * The identity of the file is returned in fileid, to be given back to
+ * script_cache_store() when the script has to be loaded.
+ */
+bool
+script_cache_lookup(const char *filename,
+					const char **values, int nvalues,
+					ScriptFileId *fileid,
+					char **sql, List **raw_parsetree_list)
+{
+	struct stat st;
+	ScriptCacheKey key;
+	StringInfoData buf;
+	ScriptCacheEntry *entry;
+
+	fileid->valid = false;
+
+	if (extwlist_script_cache_size <= 0)
+		return false;
+
+	if (stat(filename, &st) != 0)
+		return false;
+
+	fileid->valid = true;
+	fileid->dev = st.st_dev;
+	fileid->ino = st.st_ino;
+	fileid->mtime = st.st_mtime;
+	fileid->mtime_nsec = ST_MTIME_NSEC(st);
+	fileid->ctime = st.st_ctime;
+	fileid->ctime_nsec = ST_CTIME_NSEC(st);
+	fileid->size = st.st_size;
+
+	if (script_cache == NULL)
+		init_script_cache();
+
+	initStringInfo(&buf);
+	make_script_cache_key(&key, &buf, filename, values, nvalues);
+
+	entry = (ScriptCacheEntry *) hash_search(script_cache, &key,
+											 HASH_FIND, NULL);
+
+	if (entry == NULL
+		|| entry->fileid.dev != fileid->dev
+		|| entry->fileid.ino != fileid->ino
+		|| entry->fileid.mtime != fileid->mtime
+		|| entry->fileid.mtime_nsec != fileid->mtime_nsec
+		|| entry->fileid.ctime != fileid->ctime
+		|| entry->fileid.ctime_nsec != fileid->ctime_nsec
+		|| entry->fileid.size != fileid->size
+		|| entry->values_len != buf.len
+		|| memcmp(entry->values, buf.data, buf.len) != 0)
+	{
+		script_cache_misses++;
+		pfree(buf.data);
+		return false;
+	}
+
+	script_cache_hits++;
+	pfree(buf.data);
+
+	dlist_move_head(&script_cache_lru, &entry->lru_node);
+
+	*sql = pstrdup(entry->sql);
+	*raw_parsetree_list = (List *) copyObject(entry->raw_parsetree_list);
+
+	return true;
+}
+
+/*
+ * Add a freshly loaded and parsed script to the cache.
+ */
+void
+script_cache_store(const char *filename,
+				   const char **values, int nvalues,
+				   const ScriptFileId *fileid,
+				   const char *sql, List *raw_parsetree_list)
+{
+	Size		limit = (Size) extwlist_script_cache_size * 1024;
+	ScriptCacheKey key;
+	StringInfoData buf;
+	ScriptCacheEntry *entry;
+	MemoryContext context;
+	MemoryContext oldcontext;
+	bool		found;
+
+	if (limit == 0 || !fileid->valid)
+		return;
+
+	if (script_cache == NULL)
+		init_script_cache();
+
+	initStringInfo(&buf);
+	make_script_cache_key(&key, &buf, filename, values, nvalues);
+
+	/* a previous version of the script might still be around */
+	entry = (ScriptCacheEntry *) hash_search(script_cache, &key,
+											 HASH_FIND, NULL);
+	if (entry)
+		remove_script_cache_entry(entry);
+
+	/* don't copy a script only to evict it right away */
+	if (!script_cache_would_keep(strlen(sql)))
+	{
+		pfree(buf.data);
+		return;
+	}
+
+	context = AllocSetContextCreate(ScriptCacheContext,
+									"pgextwlist cached script",
+									ALLOCSET_DEFAULT_SIZES);
+	oldcontext = MemoryContextSwitchTo(context);
+
+	PG_TRY();
+	{
+		char	   *c_values = palloc(buf.len);
+		char	   *c_sql = pstrdup(sql);
+		List	   *c_raw = (List *) copyObject(raw_parsetree_list);
+
+		memcpy(c_values, buf.data, buf.len);
+
+		entry = (ScriptCacheEntry *) hash_search(script_cache, &key,
+												 HASH_ENTER, &found);
+		entry->fileid = *fileid;
+		entry->values = c_values;
+		entry->values_len = buf.len;
+		entry->sql = c_sql;
+		entry->raw_parsetree_list = c_raw;
+		entry->context = context;
+	}
+	PG_CATCH();
+	{
+		MemoryContextSwitchTo(oldcontext);
+		MemoryContextDelete(context);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	MemoryContextSwitchTo(oldcontext);
+	pfree(buf.data);
+
+#if PG_MAJOR_VERSION >= 1300
+	entry->size = MemoryContextMemAllocated(context, true);
+#else
+	entry->size = SCRIPT_CACHE_TREE_FACTOR * strlen(entry->sql);
+#endif
+
+	dlist_push_head(&script_cache_lru, &entry->lru_node);
+	script_cache_used += entry->size;
+
+	/* the parse trees might still be bigger than we guessed */
+	evict_script_cache(limit);
+}
+
+/*
+ * extwlist.script_cache_stats()
+ *
+ * Report this backend's script cache usage.
+ */
+Datum
+extwlist_script_cache_stats(PG_FUNCTION_ARGS)
+{
+	TupleDesc	tupdesc;
+	Datum		values[4];
+	bool		nulls[4];
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+	tupdesc = BlessTupleDesc(tupdesc);
+
+	MemSet(nulls, 0, sizeof(nulls));
+	values[0] = Int64GetDatum(script_cache_hits);
+	values[1] = Int64GetDatum(script_cache_misses);
+	values[2] = Int32GetDatum(script_cache ? hash_get_num_entries(script_cache) : 0);
+	values[3] = Int64GetDatum((int64) script_cache_used);
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, values, nulls)));
+}
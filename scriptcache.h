@@ -0,0 +1,50 @@
+/* PostgreSQL Extension WhiteList -- Dimitri Fontaine
+ *
+ * Author: Dimitri Fontaine <dimitri@2ndQuadrant.fr>
+ * Licence: PostgreSQL
+ * Copyright Dimitri Fontaine, 2011-2013
+ *
+ * For a description of the features see the README.md file from the same
+ * distribution.
+ */
+
+#ifndef __SCRIPTCACHE_H__
+#define __SCRIPTCACHE_H__
+
+#include <sys/types.h>
+#include <time.h>
+
+#include "nodes/pg_list.h"
+
+extern int	extwlist_script_cache_size;
+
+/*
+ * Identity of a script file, as seen when looking it up in the cache.
+ */
+typedef struct ScriptFileId
+{
+	bool		valid;
+	dev_t		dev;
+	ino_t		ino;
+	time_t		mtime;
+	long		mtime_nsec;
+	time_t		ctime;			/* changes when tools restore the mtime */
+	long		ctime_nsec;
+	off_t		size;
+} ScriptFileId;
+
+void assign_extwlist_script_cache_size(int newval, void *extra);
+
+bool script_cache_would_keep(size_t len);
+
+bool script_cache_lookup(const char *filename,
+						 const char **values, int nvalues,
+						 ScriptFileId *fileid,
+						 char **sql, List **raw_parsetree_list);
+
+void script_cache_store(const char *filename,
+						const char **values, int nvalues,
+						const ScriptFileId *fileid,
+						const char *sql, List *raw_parsetree_list);
+
+#endif
@@ -0,0 +1,360 @@
+/* PostgreSQL Extension WhiteList -- Dimitri Fontaine
+ *
+ * Author: Dimitri Fontaine <dimitri@2ndQuadrant.fr>
+ * Licence: PostgreSQL
+ * Copyright Dimitri Fontaine, 2011-2013
+ *
+ * For a description of the features see the README.md file from the same
+ * distribution.
+ */
+
+/*
+ * In-memory index of the custom scripts found in extwlist.custom_path.
+ *
+ * Most of the custom scripts we consider don't exist, and the custom_path
+ * might live on a slow volume.  Rather than probing for each file with
+ * access(), we list the whole tree once and keep the result in memory:
+ *
+ *   extension name -> list of before* and after* .sql file names
+ *
+ * The index is kept valid either thanks to inotify, when available, or by
+ * checking the modification time of the custom_path directory and of the
+ * extension's directory, which both change when a file is added, renamed
+ * or removed.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#define USE_INOTIFY
+#endif
+#include "postgres.h"
+
+#include "pgextwlist.h"
+#include "utils.h"
+#include "scriptindex.h"
+
+#include "storage/fd.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+
+#if PG_MAJOR_VERSION >= 1400
+#define SCRIPT_INDEX_HASH_FLAGS (HASH_ELEM | HASH_STRINGS | HASH_CONTEXT)
+#else
+#define SCRIPT_INDEX_HASH_FLAGS (HASH_ELEM | HASH_CONTEXT)
+#endif
+
+typedef struct ScriptDir
+{
+	NameData	extname;		/* hash key, must be first */
+	time_t		mtime;			/* of the extension's directory */
+	int			nfiles;
+	char	  **files;			/* custom script file names */
+} ScriptDir;
+
+static MemoryContext ScriptIndexContext = NULL;
+static HTAB *script_index = NULL;
+
+static bool script_index_valid = false;
+static bool script_index_racy = false;	/* rebuild at next lookup */
+static bool script_index_exists = false;	/* custom_path is a directory */
+static time_t script_index_mtime = 0;	/* of custom_path itself */
+
+#ifdef USE_INOTIFY
+static int	inotify_fd = -1;
+#endif
+
+static void build_script_index(void);
+
+/*
+ * GUC assign_hook for extwlist.custom_path
+ */
+void
+assign_extwlist_custom_path(const char *newval, void *extra)
+{
+	script_index_valid = false;
+}
+
+#ifdef USE_INOTIFY
+static void
+close_inotify(void)
+{
+	if (inotify_fd >= 0)
+	{
+		close(inotify_fd);
+		inotify_fd = -1;
+#if PG_MAJOR_VERSION >= 1300
+		ReleaseExternalFD();
+#endif
+	}
+}
+
+static void
+open_inotify(void)
+{
+#if PG_MAJOR_VERSION >= 1300
+	if (!AcquireExternalFD())
+		return;
+#endif
+
+	inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+	if (inotify_fd < 0)
+	{
+		elog(DEBUG1, "could not initialize inotify: %m");
+#if PG_MAJOR_VERSION >= 1300
+		ReleaseExternalFD();
+#endif
+	}
+}
+
+/*
+ * When we fail to watch a directory, fall back to checking mtimes.
+ */
+static void
+watch_directory(const char *path)
+{
+	if (inotify_fd < 0)
+		return;
+
+	if (inotify_add_watch(inotify_fd, path,
+						  IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO
+						  | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR) < 0)
+	{
+		elog(DEBUG1, "could not watch directory \"%s\": %m", path);
+		close_inotify();
+	}
+}
+#else
+#define close_inotify()		((void) 0)
+#define open_inotify()		((void) 0)
+#define watch_directory(p)	((void) 0)
+#endif							/* USE_INOTIFY */
+
+static bool
+is_custom_script_name(const char *name)
+{
+	size_t		len = strlen(name);
+
+	if (len < 4 || strcmp(name + len - 4, ".sql") != 0)
+		return false;
+
+	return strncmp(name, "before", 6) == 0 || strncmp(name, "after", 5) == 0;
+}
+
+/*
+ * List the custom scripts found in the given extension's directory.
+ */
+static void
+scan_script_dir(const char *extname, const char *path, time_t mtime)
+{
+	ScriptDir  *entry;
+	DIR		   *dir;
+	struct dirent *de;
+	int			allocated = 8;
+
+	watch_directory(path);
+
+	if ((dir = AllocateDir(path)) == NULL)
+		return;
+
+	entry = (ScriptDir *) hash_search(script_index, extname, HASH_ENTER, NULL);
+	entry->mtime = mtime;
+	entry->nfiles = 0;
+	entry->files = (char **)
+		MemoryContextAlloc(ScriptIndexContext, allocated * sizeof(char *));
+
+	while ((de = ReadDir(dir, path)) != NULL)
+	{
+		if (!is_custom_script_name(de->d_name))
+			continue;
+
+		if (entry->nfiles == allocated)
+		{
+			allocated *= 2;
+			entry->files = (char **)
+				repalloc(entry->files, allocated * sizeof(char *));
+		}
+		entry->files[entry->nfiles++] =
+			MemoryContextStrdup(ScriptIndexContext, de->d_name);
+	}
+
+	FreeDir(dir);
+}
+
+/*
+ * Scan the whole extwlist.custom_path tree.
+ */
+static void
+build_script_index(void)
+{
+	const char *root = extwlist_custom_path;
+	time_t		started = time(NULL);
+	time_t		newest;
+	struct stat st;
+	HASHCTL		ctl;
+	DIR		   *dir;
+	struct dirent *de;
+
+	if (ScriptIndexContext == NULL)
+		ScriptIndexContext = AllocSetContextCreate(TopMemoryContext,
+												   "pgextwlist script index",
+												   ALLOCSET_SMALL_SIZES);
+	else
+		MemoryContextReset(ScriptIndexContext);
+
+	script_index = NULL;
+	script_index_valid = false;
+	script_index_exists = false;
+	script_index_mtime = 0;
+
+	close_inotify();
+	open_inotify();
+
+	MemSet(&ctl, 0, sizeof(ctl));
+	ctl.keysize = NAMEDATALEN;
+	ctl.entrysize = sizeof(ScriptDir);
+	ctl.hcxt = ScriptIndexContext;
+
+	script_index = hash_create("pgextwlist script index", 64, &ctl,
+							   SCRIPT_INDEX_HASH_FLAGS);
+
+	if (root == NULL || root[0] == '\0'
+		|| stat(root, &st) != 0 || !S_ISDIR(st.st_mode))
+	{
+		/* with inotify we can't watch a missing directory */
+		close_inotify();
+		script_index_racy = false;
+		script_index_valid = true;
+		return;
+	}
+
+	script_index_exists = true;
+	script_index_mtime = newest = st.st_mtime;
+
+	watch_directory(root);
+
+	if ((dir = AllocateDir(root)) == NULL)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not open directory \"%s\": %m", root)));
+
+	while ((de = ReadDir(dir, root)) != NULL)
+	{
+		char		path[MAXPGPATH];
+
+		if (de->d_name[0] == '.' || strlen(de->d_name) >= NAMEDATALEN)
+			continue;
+
+		snprintf(path, MAXPGPATH, "%s/%s", root, de->d_name);
+
+		if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode))
+			continue;
+
+		if (st.st_mtime > newest)
+			newest = st.st_mtime;
+
+		scan_script_dir(de->d_name, path, st.st_mtime);
+	}
+
+	FreeDir(dir);
+
+	/*
+	 * Without inotify, a directory modified in the same second as we scanned
+	 * it might change again without its mtime changing: in that case, scan
+	 * again at next lookup, until things settle down.
+	 */
+#ifdef USE_INOTIFY
+	script_index_racy = inotify_fd < 0 && newest >= started - 1;
+#else
+	script_index_racy = newest >= started - 1;
+#endif
+	script_index_valid = true;
+}
+
+/*
+ * Check whether the index is still valid for given extension.
+ */
+static bool
+script_index_is_current(const char *extname)
+{
+	struct stat st;
+	ScriptDir  *entry;
+
+	if (!script_index_valid || script_index_racy)
+		return false;
+
+#ifdef USE_INOTIFY
+	if (inotify_fd >= 0)
+	{
+		char		buf[1024];
+		ssize_t		nbytes = read(inotify_fd, buf, sizeof(buf));
+
+		/* any event at all means we have to scan again */
+		if (nbytes > 0 || (nbytes < 0 && errno != EAGAIN))
+			return false;
+		return true;
+	}
+#endif
+
+	if (extwlist_custom_path == NULL || extwlist_custom_path[0] == '\0'
+		|| stat(extwlist_custom_path, &st) != 0 || !S_ISDIR(st.st_mode))
+		return !script_index_exists;
+
+	if (!script_index_exists || st.st_mtime != script_index_mtime)
+		return false;
+
+	entry = (ScriptDir *) hash_search(script_index, extname, HASH_FIND, NULL);
+
+	if (entry)
+	{
+		char		path[MAXPGPATH];
+
+		snprintf(path, MAXPGPATH, "%s/%s", extwlist_custom_path, extname);
+
+		if (stat(path, &st) != 0 || st.st_mtime != entry->mtime)
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Does the given custom script exist? filename is expected to have been
+ * built by get_specific_custom_script_filename() or
+ * get_generic_custom_script_filename() for the same extension.
+ */
+bool
+custom_script_exists(const char *extname, const char *filename)
+{
+	ScriptDir  *entry;
+	const char *basename;
+	int			i;
+
+	if (filename == NULL)
+		return false;
+
+	if (!script_index_is_current(extname))
+		build_script_index();
+
+	if (!script_index_exists)
+		return false;
+
+	entry = (ScriptDir *) hash_search(script_index, extname, HASH_FIND, NULL);
+
+	if (entry == NULL)
+		return false;
+
+	basename = last_dir_separator(filename);
+	basename = basename ? basename + 1 : filename;
+
+	for (i = 0; i < entry->nfiles; i++)
+	{
+		if (strcmp(entry->files[i], basename) == 0)
+			return true;
+	}
+	return false;
+}
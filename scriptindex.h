@@ -0,0 +1,18 @@
+/* PostgreSQL Extension WhiteList -- Dimitri Fontaine
+ *
+ * Author: Dimitri Fontaine <dimitri@2ndQuadrant.fr>
+ * Licence: PostgreSQL
+ * Copyright Dimitri Fontaine, 2011-2013
+ *
+ * For a description of the features see the README.md file from the same
+ * distribution.
+ */
+
+#ifndef __SCRIPTINDEX_H__
+#define __SCRIPTINDEX_H__
+
+void assign_extwlist_custom_path(const char *newval, void *extra);
+
+bool custom_script_exists(const char *extname, const char *filename);
+
+#endif
@@ -0,0 +1,292 @@
+/* PostgreSQL Extension WhiteList -- Dimitri Fontaine
+ *
+ * Author: Dimitri Fontaine <dimitri@2ndQuadrant.fr>
+ * Licence: PostgreSQL
+ * Copyright Dimitri Fontaine, 2011-2013
+ *
+ * For a description of the features see the README.md file from the same
+ * distribution.
+ */
+
+/*
+ * Shared memory, when loaded from shared_preload_libraries.
+ *
+ * The module is then loaded once in the postmaster and inherited by the
+ * backends, and the parsed extension control files are published in a
+ * shared hash table, so that new backends don't have to parse them again.
+ * The per-backend cache in control.c remains the first level cache.  The
+ * statistics of stats.c and the audit trail of audit.c are kept there too.
+ *
+ * The whitelist itself is not shared: it comes from a GUC that is usually
+ * set per role or per database, so each backend has its own.  Likewise
+ * extwlist.custom_path may differ between backends, and the custom scripts
+ * index is kept per backend.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "postgres.h"
+
+#include "pgextwlist.h"
+#include "audit.h"
+#include "shmem.h"
+#include "stats.h"
+
+#include "lib/stringinfo.h"
+#include "miscadmin.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/builtins.h"
+#include "utils/hsearch.h"
+#if PG_MAJOR_VERSION >= 1000
+#include "utils/varlena.h"
+#endif
+
+#define EXTWLIST_TRANCHE_NAME		"pgextwlist"
+
+/* how many control files we keep in shared memory */
+#define SHARED_CONTROL_ENTRIES		512
+
+/* room for the quoted, comma separated list of required extensions */
+#define SHARED_CONTROL_REQUIRES_LEN	256
+
+typedef struct SharedControlEntry
+{
+	NameData	name;			/* hash key, must be first */
+	dev_t		dev;
+	ino_t		ino;
+	time_t		mtime;
+	off_t		size;
+	bool		has_default_version;
+	NameData	default_version;
+	bool		has_schema;
+	NameData	schema;
+	bool		relocatable;
+	char		requires[SHARED_CONTROL_REQUIRES_LEN];
+} SharedControlEntry;
+
+ExtwlistSharedState *extwlist_shared = NULL;
+
+/* Shared mode needs named LWLock tranches, available from 9.6 on */
+#if PG_MAJOR_VERSION >= 906
+
+static HTAB *shared_control = NULL;
+
+#if PG_MAJOR_VERSION >= 1500
+static shmem_request_hook_type prev_shmem_request_hook = NULL;
+#endif
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+static Size
+extwlist_shmem_size(void)
+{
+	Size		size = MAXALIGN(sizeof(ExtwlistSharedState));
+
+	size = add_size(size, hash_estimate_size(SHARED_CONTROL_ENTRIES,
+											 sizeof(SharedControlEntry)));
+	size = add_size(size, extwlist_stats_shmem_size());
+	size = add_size(size, extwlist_audit_shmem_size());
+
+	return size;
+}
+
+static void
+extwlist_shmem_request(void)
+{
+#if PG_MAJOR_VERSION >= 1500
+	if (prev_shmem_request_hook)
+		prev_shmem_request_hook();
+#endif
+
+	RequestAddinShmemSpace(extwlist_shmem_size());
+	RequestNamedLWLockTranche(EXTWLIST_TRANCHE_NAME, 1);
+}
+
+static void
+extwlist_shmem_startup(void)
+{
+	bool		found;
+	HASHCTL		info;
+
+	if (prev_shmem_startup_hook)
+		prev_shmem_startup_hook();
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	extwlist_shared = ShmemInitStruct("pgextwlist",
+									  sizeof(ExtwlistSharedState),
+									  &found);
+	if (!found)
+		extwlist_shared->lock =
+			&(GetNamedLWLockTranche(EXTWLIST_TRANCHE_NAME))->lock;
+
+	MemSet(&info, 0, sizeof(info));
+	info.keysize = sizeof(NameData);
+	info.entrysize = sizeof(SharedControlEntry);
+
+	shared_control = ShmemInitHash("pgextwlist control files",
+								   SHARED_CONTROL_ENTRIES,
+								   SHARED_CONTROL_ENTRIES,
+								   &info,
+								   HASH_ELEM | HASH_BLOBS);
+
+	extwlist_stats_shmem_startup();
+	extwlist_audit_shmem_startup();
+
+	LWLockRelease(AddinShmemInitLock);
+}
+
+#endif	/* PG_MAJOR_VERSION >= 906 */
+
+/*
+ * Install our shared memory hooks, when loaded from shared_preload_libraries.
+ * Otherwise every backend keeps to its own caches.
+ */
+void
+extwlist_shmem_init(void)
+{
+#if PG_MAJOR_VERSION >= 906
+	if (!process_shared_preload_libraries_in_progress)
+		return;
+
+#if PG_MAJOR_VERSION >= 1500
+	prev_shmem_request_hook = shmem_request_hook;
+	shmem_request_hook = extwlist_shmem_request;
+#else
+	extwlist_shmem_request();
+#endif
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = extwlist_shmem_startup;
+#endif
+}
+
+/*
+ * Fill in control with the shared copy of given extension's control file,
+ * allocated in the current memory context, when it's there and the file
+ * didn't change since.
+ */
+bool
+shared_control_lookup(const char *extname, const struct stat *st,
+					  ExtensionControl *control)
+{
+#if PG_MAJOR_VERSION >= 906
+	NameData	key;
+	SharedControlEntry *entry;
+	char	   *requires = NULL;
+
+	if (extwlist_shared == NULL)
+		return false;
+
+	MemSet(&key, 0, sizeof(key));
+	namestrcpy(&key, extname);
+
+	LWLockAcquire(extwlist_shared->lock, LW_SHARED);
+
+	entry = (SharedControlEntry *) hash_search(shared_control, &key,
+											   HASH_FIND, NULL);
+
+	if (entry == NULL
+		|| entry->dev != st->st_dev
+		|| entry->ino != st->st_ino
+		|| entry->mtime != st->st_mtime
+		|| entry->size != st->st_size)
+	{
+		LWLockRelease(extwlist_shared->lock);
+		return false;
+	}
+
+	/* palloc could fail, don't hold the lock any longer than needed */
+	control->default_version = NULL;
+	control->schema = NULL;
+	control->requires = NIL;
+	control->relocatable = entry->relocatable;
+
+	if (entry->has_default_version)
+		control->default_version = pstrdup(NameStr(entry->default_version));
+	if (entry->has_schema)
+		control->schema = pstrdup(NameStr(entry->schema));
+	if (entry->requires[0] != '\0')
+		requires = pstrdup(entry->requires);
+
+	LWLockRelease(extwlist_shared->lock);
+
+	if (requires)
+		(void) SplitIdentifierString(requires, ',', &control->requires);
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+/*
+ * Publish a freshly parsed control file for the other backends.  Values that
+ * don't fit in the shared entry are only kept in our own cache.
+ */
+void
+shared_control_store(const char *extname, const struct stat *st,
+					 const ExtensionControl *control)
+{
+#if PG_MAJOR_VERSION >= 906
+	NameData	key;
+	StringInfoData requires;
+	ListCell   *lc;
+	SharedControlEntry *entry;
+
+	if (extwlist_shared == NULL)
+		return;
+
+	if ((control->default_version
+		 && strlen(control->default_version) >= NAMEDATALEN)
+		|| (control->schema && strlen(control->schema) >= NAMEDATALEN))
+		return;
+
+	initStringInfo(&requires);
+	foreach(lc, control->requires)
+	{
+		if (requires.len > 0)
+			appendStringInfoChar(&requires, ',');
+		appendStringInfoString(&requires,
+							   quote_identifier((const char *) lfirst(lc)));
+	}
+
+	if (requires.len >= SHARED_CONTROL_REQUIRES_LEN)
+	{
+		pfree(requires.data);
+		return;
+	}
+
+	MemSet(&key, 0, sizeof(key));
+	namestrcpy(&key, extname);
+
+	LWLockAcquire(extwlist_shared->lock, LW_EXCLUSIVE);
+
+	/* when the table is full, other backends just parse the file */
+	entry = (SharedControlEntry *) hash_search(shared_control, &key,
+											   HASH_ENTER_NULL, NULL);
+	if (entry)
+	{
+		entry->dev = st->st_dev;
+		entry->ino = st->st_ino;
+		entry->mtime = st->st_mtime;
+		entry->size = st->st_size;
+
+		entry->has_default_version = control->default_version != NULL;
+		if (control->default_version)
+			namestrcpy(&entry->default_version, control->default_version);
+
+		entry->has_schema = control->schema != NULL;
+		if (control->schema)
+			namestrcpy(&entry->schema, control->schema);
+
+		entry->relocatable = control->relocatable;
+		strlcpy(entry->requires, requires.data, SHARED_CONTROL_REQUIRES_LEN);
+	}
+
+	LWLockRelease(extwlist_shared->lock);
+
+	pfree(requires.data);
+#endif
+}
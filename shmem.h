@@ -0,0 +1,38 @@
+/* PostgreSQL Extension WhiteList -- Dimitri Fontaine
+ *
+ * Author: Dimitri Fontaine <dimitri@2ndQuadrant.fr>
+ * Licence: PostgreSQL
+ * Copyright Dimitri Fontaine, 2011-2013
+ *
+ * For a description of the features see the README.md file from the same
+ * distribution.
+ */
+
+#ifndef __SHMEM_H__
+#define __SHMEM_H__
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "control.h"
+#include "storage/lwlock.h"
+
+/*
+ * State shared by all the backends, only available when the module is
+ * loaded from shared_preload_libraries.
+ */
+typedef struct ExtwlistSharedState
+{
+	LWLock	   *lock;			/* protects the shared hash tables */
+} ExtwlistSharedState;
+
+extern ExtwlistSharedState *extwlist_shared;
+
+void extwlist_shmem_init(void);
+
+bool shared_control_lookup(const char *extname, const struct stat *st,
+						   ExtensionControl *control);
+void shared_control_store(const char *extname, const struct stat *st,
+						  const ExtensionControl *control);
+
+#endif
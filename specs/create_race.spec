@@ -0,0 +1,31 @@
+# Concurrent CREATE EXTENSION IF NOT EXISTS of a whitelisted extension with
+# custom scripts, by non superusers: the second session waits for the first
+# one to commit or rollback, and then skips the command or runs it.  When it
+# skips it, it doesn't run the custom scripts again either: the comment
+# changed by the first session stays.
+
+setup
+{
+  DROP EXTENSION IF EXISTS refint;
+}
+
+teardown
+{
+  DROP EXTENSION IF EXISTS refint;
+}
+
+session s1
+setup		{ SET ROLE mere_mortal; }
+step s1b	{ BEGIN; }
+step s1c	{ CREATE EXTENSION IF NOT EXISTS refint; }
+step s1comment	{ COMMENT ON EXTENSION refint IS 'commented by s1'; }
+step s1commit	{ COMMIT; }
+step s1rollback	{ ROLLBACK; }
+
+session s2
+setup		{ SET ROLE mere_mortal; }
+step s2c	{ CREATE EXTENSION IF NOT EXISTS refint; }
+step s2check	{ SELECT extname, obj_description(oid, 'pg_extension') AS description FROM pg_extension WHERE extname = 'refint'; }
+
+permutation s1b s1c s1comment s2c s1commit s2check
+permutation s1b s1c s2c s1rollback s2check
@@ -0,0 +1,28 @@
+# Concurrent ALTER EXTENSION UPDATE of a whitelisted extension with custom
+# scripts, by non superusers: the second session waits for the first one,
+# and then updates from the version the first one installed, running the
+# custom scripts for that version rather than for the one it saw before
+# waiting.  hstore has the 1.4, 1.5 and 1.6 versions from PostgreSQL 12 on.
+
+setup
+{
+  CREATE EXTENSION hstore VERSION '1.4';
+}
+
+teardown
+{
+  DROP EXTENSION hstore;
+}
+
+session s1
+setup		{ SET extwlist.extensions = 'hstore'; SET ROLE mere_mortal; }
+step s1b	{ BEGIN; }
+step s1u	{ ALTER EXTENSION hstore UPDATE TO '1.5'; }
+step s1commit	{ COMMIT; }
+
+session s2
+setup		{ SET extwlist.extensions = 'hstore'; SET ROLE mere_mortal; }
+step s2u	{ ALTER EXTENSION hstore UPDATE TO '1.6'; }
+step s2check	{ SELECT extname, extversion, obj_description(oid, 'pg_extension') AS description FROM pg_extension WHERE extname = 'hstore'; }
+
+permutation s1b s1u s2u s1commit s2check
@@ -0,0 +1,56 @@
+-- whitelist kept in the extwlist.allowed table
+SET extwlist.extensions = '';
+INSERT INTO extwlist.allowed
+     VALUES ('hstore', 'mere_mortal'), ('pg_trgm', NULL), ('refint', 'evil_user');
+
+SET ROLE mere_mortal;
+CREATE EXTENSION hstore;
+CREATE EXTENSION pg_trgm;
+CREATE EXTENSION refint;
+RESET ROLE;
+
+-- changes to the table are seen right away
+INSERT INTO extwlist.allowed VALUES ('refint', 'mere_mortal');
+
+SET ROLE mere_mortal;
+CREATE EXTENSION refint;
+SELECT extname FROM pg_extension ORDER BY 1;
+DROP EXTENSION hstore, pg_trgm, refint;
+RESET ROLE;
+
+-- rows for a role apply to its members
+DELETE FROM extwlist.allowed WHERE extname = 'refint';
+CREATE ROLE extension_installers;
+INSERT INTO extwlist.allowed VALUES ('refint', 'extension_installers');
+
+SET ROLE mere_mortal;
+CREATE EXTENSION refint;
+RESET ROLE;
+
+GRANT extension_installers TO mere_mortal;
+SET ROLE mere_mortal;
+CREATE EXTENSION refint;
+DROP EXTENSION refint;
+RESET ROLE;
+
+REVOKE extension_installers FROM mere_mortal;
+SET ROLE mere_mortal;
+CREATE EXTENSION refint;
+RESET ROLE;
+DROP ROLE extension_installers;
+
+TRUNCATE extwlist.allowed;
+RESET extwlist.extensions;
+
+-- only the table of the extension counts, not one of the same name
+DROP EXTENSION pgextwlist;
+CREATE SCHEMA extwlist;
+CREATE TABLE extwlist.allowed (extname name, rolname name);
+INSERT INTO extwlist.allowed VALUES ('refint', NULL);
+SET extwlist.extensions = '';
+SET ROLE mere_mortal;
+CREATE EXTENSION refint;
+RESET ROLE;
+RESET extwlist.extensions;
+DROP SCHEMA extwlist CASCADE;
+CREATE EXTENSION pgextwlist;
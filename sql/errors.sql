@@ -25,3 +25,35 @@ SELECT extname FROM pg_extension ORDER BY 1;
 -- drop non-whitelisted extension
 DROP EXTENSION plpgsql;
 SELECT extname FROM pg_extension ORDER BY 1;
+
+-- syntax errors in the whitelist are reported at SET time
+RESET ROLE;
+SET extwlist.extensions = 'citext, "pg_trgm';
+SHOW extwlist.extensions;
+
+-- glob patterns in the whitelist
+SET extwlist.extensions = 'h*re, pg_?rgm';
+SET ROLE mere_mortal;
+CREATE EXTENSION hstore;
+CREATE EXTENSION pg_trgm;
+SELECT extname FROM pg_extension ORDER BY 1;
+DROP EXTENSION hstore, pg_trgm;
+CREATE EXTENSION refint;
+RESET ROLE;
+RESET extwlist.extensions;
+
+-- version constraints in the whitelist
+SET extwlist.extensions = '<1, refint';
+SET extwlist.extensions = 'refint>=';
+SET extwlist.extensions = 'postgis_an_extension_with_a_rather_long_name_of_sixty_bytes>=3.10';
+SET extwlist.extensions = 'refint>=2';
+SET ROLE mere_mortal;
+CREATE EXTENSION refint;
+RESET ROLE;
+SET extwlist.extensions = 'refint>=1.0,<2, hstore=0.1';
+SET ROLE mere_mortal;
+CREATE EXTENSION refint;
+SELECT extname, extversion FROM pg_extension WHERE extname = 'refint';
+DROP EXTENSION refint;
+RESET ROLE;
+RESET extwlist.extensions;
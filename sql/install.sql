@@ -0,0 +1,17 @@
+-- install a set of extensions at once, in dependency order
+SET ROLE mere_mortal;
+SELECT extname FROM extwlist.install(ARRAY['earthdistance', 'cube']);
+RESET ROLE;
+
+INSERT INTO extwlist.allowed VALUES ('cube', NULL);
+
+SET ROLE mere_mortal;
+SELECT extname FROM extwlist.install(ARRAY['earthdistance', 'cube', 'refint'], 'public');
+SELECT extname FROM pg_extension ORDER BY 1;
+
+-- installed extensions are skipped
+SELECT extname FROM extwlist.install(ARRAY['cube', 'refint']);
+DROP EXTENSION earthdistance, cube, refint;
+RESET ROLE;
+
+TRUNCATE extwlist.allowed;
@@ -20,5 +20,7 @@ CREATE EXTENSION pg_stat_statements;
 SELECT extname FROM pg_extension ORDER BY 1;
 SELECT proacl FROM pg_proc WHERE proname = 'pg_stat_statements_reset';
 SELECT groname FROM pg_group WHERE groname = 'stat_resetters';
+-- already installed, the custom scripts don't run again
+CREATE EXTENSION IF NOT EXISTS pg_stat_statements;
 DROP EXTENSION pg_stat_statements;
 SELECT groname FROM pg_group WHERE groname = 'stat_resetters';
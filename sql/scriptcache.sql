@@ -0,0 +1,18 @@
+CREATE EXTENSION pgextwlist;
+
+SET ROLE mere_mortal;
+
+-- custom scripts are parsed once, then served from the cache
+CREATE EXTENSION pg_stat_statements;
+DROP EXTENSION pg_stat_statements;
+CREATE EXTENSION pg_stat_statements;
+DROP EXTENSION pg_stat_statements;
+
+RESET ROLE;
+SELECT hits, misses, entries FROM extwlist.script_cache_stats();
+
+-- monitoring functions are for superusers only by default
+SET ROLE mere_mortal;
+SELECT hits, misses, entries FROM extwlist.script_cache_stats();
+SELECT count(*) FROM extwlist.pg_stat_extwlist();
+RESET ROLE;
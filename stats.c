@@ -0,0 +1,442 @@
+/* PostgreSQL Extension WhiteList -- Dimitri Fontaine
+ *
+ * Author: Dimitri Fontaine <dimitri@2ndQuadrant.fr>
+ * Licence: PostgreSQL
+ * Copyright Dimitri Fontaine, 2011-2013
+ *
+ * For a description of the features see the README.md file from the same
+ * distribution.
+ */
+
+/*
+ * Statistics about the extension commands we processed, per extension and
+ * action, kept in shared memory and exposed in the pg_stat_extwlist view.
+ *
+ * Counters are atomics, so that updating them only needs the shared lock,
+ * which is taken exclusively only to add or remove entries.  Statistics are
+ * only available when the module is loaded from shared_preload_libraries.
+ *
+ * Denied commands for names we don't have an entry for already are accounted
+ * for in a single "(other)" entry per action, so that clients can't fill the
+ * table with arbitrary names.  The table never grows past
+ * EXTWLIST_STATS_ENTRIES anyway, and makes room for new entries by evicting
+ * the least used one, as pg_stat_statements does.
+ */
+
+#include "postgres.h"
+
+#include "pgextwlist.h"
+#include "shmem.h"
+#include "stats.h"
+#include "utils.h"
+
+#include "catalog/pg_type.h"
+#include "funcapi.h"
+#include "storage/shmem.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/hsearch.h"
+
+#if PG_MAJOR_VERSION >= 906
+#include "port/atomics.h"
+#endif
+
+/* how many (extension, action) pairs we keep statistics for */
+#define EXTWLIST_STATS_ENTRIES		1024
+
+/* where denied commands on names without an entry are accounted for */
+#define EXTWLIST_STATS_OTHER		"(other)"
+
+/*
+ * Latency histogram buckets, in milliseconds: the first bucket counts
+ * commands that took less than 1ms, bucket n counts those that took from
+ * 2^(n-1) up to 2^n ms, and the last one everything slower.
+ */
+#define EXTWLIST_HISTOGRAM_BUCKETS	16
+
+static const char *const action_names[EXTWLIST_ACTION_COUNT] = {
+	"create",
+	"update",
+	"drop",
+	"comment"
+};
+
+PG_FUNCTION_INFO_V1(extwlist_pg_stat_extwlist);
+PG_FUNCTION_INFO_V1(extwlist_pg_stat_extwlist_reset);
+
+#if PG_MAJOR_VERSION >= 906
+
+typedef struct ExtwlistStatsKey
+{
+	NameData	extname;
+	int			action;			/* an ExtwlistAction */
+} ExtwlistStatsKey;
+
+typedef struct ExtwlistStatsEntry
+{
+	ExtwlistStatsKey key;		/* hash key, must be first */
+	pg_atomic_uint64 allowed;
+	pg_atomic_uint64 denied;
+	pg_atomic_uint64 lock_waits;
+	pg_atomic_uint64 lock_wait_time;	/* in microseconds */
+	pg_atomic_uint64 before_time;	/* in microseconds */
+	pg_atomic_uint64 utility_time;
+	pg_atomic_uint64 after_time;
+	pg_atomic_uint64 histogram[EXTWLIST_HISTOGRAM_BUCKETS];
+} ExtwlistStatsEntry;
+
+static HTAB *extwlist_stats = NULL;
+
+Size
+extwlist_stats_shmem_size(void)
+{
+	return hash_estimate_size(EXTWLIST_STATS_ENTRIES,
+							  sizeof(ExtwlistStatsEntry));
+}
+
+/*
+ * Called from our shmem_startup_hook, with AddinShmemInitLock held.
+ */
+void
+extwlist_stats_shmem_startup(void)
+{
+	HASHCTL		info;
+
+	MemSet(&info, 0, sizeof(info));
+	info.keysize = sizeof(ExtwlistStatsKey);
+	info.entrysize = sizeof(ExtwlistStatsEntry);
+
+	extwlist_stats = ShmemInitHash("pgextwlist statistics",
+								   EXTWLIST_STATS_ENTRIES,
+								   EXTWLIST_STATS_ENTRIES,
+								   &info,
+								   HASH_ELEM | HASH_BLOBS);
+}
+
+bool
+extwlist_stats_enabled(void)
+{
+	return extwlist_shared != NULL && extwlist_stats != NULL;
+}
+
+/*
+ * Remove the least used entry, the one with the fewest allowed commands and
+ * then the fewest denied ones.  Called with the exclusive lock held.
+ */
+static void
+evict_stats_entry(void)
+{
+	HASH_SEQ_STATUS hash_seq;
+	ExtwlistStatsEntry *entry;
+	ExtwlistStatsEntry *victim = NULL;
+	uint64		victim_allowed = 0;
+	uint64		victim_denied = 0;
+
+	hash_seq_init(&hash_seq, extwlist_stats);
+	while ((entry = hash_seq_search(&hash_seq)) != NULL)
+	{
+		uint64		allowed = pg_atomic_read_u64(&entry->allowed);
+		uint64		denied = pg_atomic_read_u64(&entry->denied);
+
+		if (victim == NULL
+			|| allowed < victim_allowed
+			|| (allowed == victim_allowed && denied < victim_denied))
+		{
+			victim = entry;
+			victim_allowed = allowed;
+			victim_denied = denied;
+		}
+	}
+
+	if (victim)
+		(void) hash_search(extwlist_stats, &victim->key, HASH_REMOVE, NULL);
+}
+
+/*
+ * Find the entry for given extension and action, creating it when asked to,
+ * and return it with the shared lock held.  Return NULL, still with the lock
+ * held, when there's no such entry or we are out of shared memory.
+ */
+static ExtwlistStatsEntry *
+get_stats_entry(const char *extname, ExtwlistAction action, bool create)
+{
+	ExtwlistStatsKey key;
+	ExtwlistStatsEntry *entry;
+	bool		found;
+	int			i;
+
+	MemSet(&key, 0, sizeof(key));
+	namestrcpy(&key.extname, extname);
+	key.action = action;
+
+	LWLockAcquire(extwlist_shared->lock, LW_SHARED);
+
+	entry = (ExtwlistStatsEntry *) hash_search(extwlist_stats, &key,
+											   HASH_FIND, NULL);
+	if (entry || !create)
+		return entry;
+
+	/* upgrade to an exclusive lock to add the entry */
+	LWLockRelease(extwlist_shared->lock);
+	LWLockAcquire(extwlist_shared->lock, LW_EXCLUSIVE);
+
+	entry = (ExtwlistStatsEntry *) hash_search(extwlist_stats, &key,
+											   HASH_FIND, NULL);
+
+	if (entry == NULL
+		&& hash_get_num_entries(extwlist_stats) >= EXTWLIST_STATS_ENTRIES)
+		evict_stats_entry();
+
+	entry = (ExtwlistStatsEntry *) hash_search(extwlist_stats, &key,
+											   HASH_ENTER_NULL, &found);
+	if (entry && !found)
+	{
+		pg_atomic_init_u64(&entry->allowed, 0);
+		pg_atomic_init_u64(&entry->denied, 0);
+		pg_atomic_init_u64(&entry->lock_waits, 0);
+		pg_atomic_init_u64(&entry->lock_wait_time, 0);
+		pg_atomic_init_u64(&entry->before_time, 0);
+		pg_atomic_init_u64(&entry->utility_time, 0);
+		pg_atomic_init_u64(&entry->after_time, 0);
+		for (i = 0; i < EXTWLIST_HISTOGRAM_BUCKETS; i++)
+			pg_atomic_init_u64(&entry->histogram[i], 0);
+	}
+
+	LWLockRelease(extwlist_shared->lock);
+
+	/* another backend may evict the entry before we get the lock again */
+	LWLockAcquire(extwlist_shared->lock, LW_SHARED);
+
+	if (entry)
+		entry = (ExtwlistStatsEntry *) hash_search(extwlist_stats, &key,
+												   HASH_FIND, NULL);
+	return entry;
+}
+
+static int
+histogram_bucket(uint64 usecs)
+{
+	uint64		msecs = usecs / 1000;
+	int			bucket = 0;
+
+	while (msecs > 0 && bucket < EXTWLIST_HISTOGRAM_BUCKETS - 1)
+	{
+		msecs >>= 1;
+		bucket++;
+	}
+	return bucket;
+}
+
+void
+extwlist_stats_allowed(const char *extname, ExtwlistAction action,
+					   const ExtwlistTimings *timings)
+{
+	ExtwlistStatsEntry *entry;
+	uint64		before = INSTR_TIME_GET_MICROSEC(timings->before);
+	uint64		utility = INSTR_TIME_GET_MICROSEC(timings->utility);
+	uint64		after = INSTR_TIME_GET_MICROSEC(timings->after);
+
+	if (!extwlist_stats_enabled() || extname == NULL)
+		return;
+
+	entry = get_stats_entry(extname, action, true);
+	if (entry)
+	{
+		pg_atomic_fetch_add_u64(&entry->allowed, 1);
+		pg_atomic_fetch_add_u64(&entry->before_time, before);
+		pg_atomic_fetch_add_u64(&entry->utility_time, utility);
+		pg_atomic_fetch_add_u64(&entry->after_time, after);
+		pg_atomic_fetch_add_u64(&entry->histogram[histogram_bucket(before + utility + after)], 1);
+	}
+	LWLockRelease(extwlist_shared->lock);
+}
+
+void
+extwlist_stats_denied(const char *extname, ExtwlistAction action)
+{
+	ExtwlistStatsEntry *entry;
+
+	if (!extwlist_stats_enabled() || extname == NULL)
+		return;
+
+	entry = get_stats_entry(extname, action, false);
+	if (entry == NULL)
+	{
+		LWLockRelease(extwlist_shared->lock);
+		entry = get_stats_entry(EXTWLIST_STATS_OTHER, action, true);
+	}
+	if (entry)
+		pg_atomic_fetch_add_u64(&entry->denied, 1);
+	LWLockRelease(extwlist_shared->lock);
+}
+
+void
+extwlist_stats_lock_wait(const char *extname, ExtwlistAction action,
+						 uint64 usecs)
+{
+	ExtwlistStatsEntry *entry;
+
+	if (!extwlist_stats_enabled() || extname == NULL)
+		return;
+
+	entry = get_stats_entry(extname, action, true);
+	if (entry)
+	{
+		pg_atomic_fetch_add_u64(&entry->lock_waits, 1);
+		pg_atomic_fetch_add_u64(&entry->lock_wait_time, usecs);
+	}
+	LWLockRelease(extwlist_shared->lock);
+}
+
+#else							/* PG_MAJOR_VERSION < 906 */
+
+Size
+extwlist_stats_shmem_size(void)
+{
+	return 0;
+}
+
+void
+extwlist_stats_shmem_startup(void)
+{
+}
+
+bool
+extwlist_stats_enabled(void)
+{
+	return false;
+}
+
+void
+extwlist_stats_allowed(const char *extname, ExtwlistAction action,
+					   const ExtwlistTimings *timings)
+{
+}
+
+void
+extwlist_stats_denied(const char *extname, ExtwlistAction action)
+{
+}
+
+void
+extwlist_stats_lock_wait(const char *extname, ExtwlistAction action,
+						 uint64 usecs)
+{
+}
+
+#endif							/* PG_MAJOR_VERSION >= 906 */
+
+ExtwlistAction
+extwlist_action_from_name(const char *action)
+{
+	int			i;
+
+	for (i = 0; i < EXTWLIST_ACTION_COUNT; i++)
+		if (strcmp(action, action_names[i]) == 0)
+			return (ExtwlistAction) i;
+
+	elog(ERROR, "unknown extension action \"%s\"", action);
+	return EXTWLIST_ACTION_COUNT;	/* keep compiler quiet */
+}
+
+const char *
+extwlist_action_name(ExtwlistAction action)
+{
+	Assert(action >= 0 && action < EXTWLIST_ACTION_COUNT);
+
+	return action_names[action];
+}
+
+static void
+check_stats_enabled(void)
+{
+	if (!extwlist_stats_enabled())
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("pgextwlist must be loaded via shared_preload_libraries")));
+}
+
+/*
+ * extwlist.pg_stat_extwlist()
+ */
+Datum
+extwlist_pg_stat_extwlist(PG_FUNCTION_ARGS)
+{
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+
+	check_stats_enabled();
+
+	tupstore = materialize_srf_result(fcinfo, &tupdesc);
+
+#if PG_MAJOR_VERSION >= 906
+	{
+		HASH_SEQ_STATUS hash_seq;
+		ExtwlistStatsEntry *entry;
+
+		LWLockAcquire(extwlist_shared->lock, LW_SHARED);
+
+		hash_seq_init(&hash_seq, extwlist_stats);
+		while ((entry = hash_seq_search(&hash_seq)) != NULL)
+		{
+			Datum		values[10];
+			bool		nulls[10];
+			Datum		buckets[EXTWLIST_HISTOGRAM_BUCKETS];
+			int			i;
+
+			MemSet(nulls, 0, sizeof(nulls));
+
+			for (i = 0; i < EXTWLIST_HISTOGRAM_BUCKETS; i++)
+				buckets[i] = Int64GetDatum((int64) pg_atomic_read_u64(&entry->histogram[i]));
+
+			values[0] = NameGetDatum(&entry->key.extname);
+			values[1] = CStringGetTextDatum(action_names[entry->key.action]);
+			values[2] = Int64GetDatum((int64) pg_atomic_read_u64(&entry->allowed));
+			values[3] = Int64GetDatum((int64) pg_atomic_read_u64(&entry->denied));
+			values[4] = Int64GetDatum((int64) pg_atomic_read_u64(&entry->lock_waits));
+			values[5] = Float8GetDatum(pg_atomic_read_u64(&entry->lock_wait_time) / 1000.0);
+			values[6] = Float8GetDatum(pg_atomic_read_u64(&entry->before_time) / 1000.0);
+			values[7] = Float8GetDatum(pg_atomic_read_u64(&entry->utility_time) / 1000.0);
+			values[8] = Float8GetDatum(pg_atomic_read_u64(&entry->after_time) / 1000.0);
+			values[9] = PointerGetDatum(construct_array(buckets,
+														EXTWLIST_HISTOGRAM_BUCKETS,
+														INT8OID,
+														sizeof(int64),
+														FLOAT8PASSBYVAL,
+														'd'));
+
+			tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+		}
+
+		LWLockRelease(extwlist_shared->lock);
+	}
+#endif
+
+	return (Datum) 0;
+}
+
+/*
+ * extwlist.pg_stat_extwlist_reset()
+ */
+Datum
+extwlist_pg_stat_extwlist_reset(PG_FUNCTION_ARGS)
+{
+	check_stats_enabled();
+
+#if PG_MAJOR_VERSION >= 906
+	{
+		HASH_SEQ_STATUS hash_seq;
+		ExtwlistStatsEntry *entry;
+
+		LWLockAcquire(extwlist_shared->lock, LW_EXCLUSIVE);
+
+		hash_seq_init(&hash_seq, extwlist_stats);
+		while ((entry = hash_seq_search(&hash_seq)) != NULL)
+			(void) hash_search(extwlist_stats, &entry->key, HASH_REMOVE, NULL);
+
+		LWLockRelease(extwlist_shared->lock);
+	}
+#endif
+
+	PG_RETURN_VOID();
+}
@@ -0,0 +1,51 @@
+/* PostgreSQL Extension WhiteList -- Dimitri Fontaine
+ *
+ * Author: Dimitri Fontaine <dimitri@2ndQuadrant.fr>
+ * Licence: PostgreSQL
+ * Copyright Dimitri Fontaine, 2011-2013
+ *
+ * For a description of the features see the README.md file from the same
+ * distribution.
+ */
+
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include "portability/instr_time.h"
+
+/*
+ * The extension commands we keep statistics for.
+ */
+typedef enum ExtwlistAction
+{
+	EXTWLIST_ACTION_CREATE,
+	EXTWLIST_ACTION_UPDATE,
+	EXTWLIST_ACTION_DROP,
+	EXTWLIST_ACTION_COMMENT,
+	EXTWLIST_ACTION_COUNT
+} ExtwlistAction;
+
+/*
+ * Time spent in each phase of an allowed command.
+ */
+typedef struct ExtwlistTimings
+{
+	instr_time	before;			/* before custom scripts */
+	instr_time	utility;		/* the command itself */
+	instr_time	after;			/* after custom scripts */
+} ExtwlistTimings;
+
+Size extwlist_stats_shmem_size(void);
+void extwlist_stats_shmem_startup(void);
+
+bool extwlist_stats_enabled(void);
+ExtwlistAction extwlist_action_from_name(const char *action);
+const char *extwlist_action_name(ExtwlistAction action);
+
+void extwlist_stats_allowed(const char *extname, ExtwlistAction action,
+							const ExtwlistTimings *timings);
+void extwlist_stats_denied(const char *extname, ExtwlistAction action);
+void extwlist_stats_lock_wait(const char *extname, ExtwlistAction action,
+							  uint64 usecs);
+
+#endif
@@ -0,0 +1,261 @@
+/* PostgreSQL Extension WhiteList -- Dimitri Fontaine
+ *
+ * Author: Dimitri Fontaine <dimitri@2ndQuadrant.fr>
+ * Licence: PostgreSQL
+ * Copyright Dimitri Fontaine, 2011-2013
+ *
+ * For a description of the features see the README.md file from the same
+ * distribution.
+ */
+
+/*
+ * Templating of the custom scripts.
+ *
+ * Before executing them, we remove the lines beginning with \echo and
+ * replace the @placeholders@ with their values, in a single pass over the
+ * script.  The values that come from the catalogs are cached, and
+ * invalidated thanks to syscache callbacks.
+ */
+
+#include "postgres.h"
+
+#include "pgextwlist.h"
+#include "template.h"
+
+#if PG_MAJOR_VERSION >= 903
+#include "access/htup_details.h"
+#else
+#include "access/htup.h"
+#endif
+
+#include "catalog/pg_database.h"
+#include "commands/dbcommands.h"
+#include "lib/stringinfo.h"
+#include "miscadmin.h"
+#include "parser/parser.h"
+#include "utils/builtins.h"
+#include "utils/inval.h"
+#include "utils/syscache.h"
+
+typedef struct Placeholder
+{
+	const char *name;
+	int			len;
+	TemplateValue value;
+} Placeholder;
+
+#define PLACEHOLDER(name, value)	{ name, sizeof(name) - 1, value }
+
+/*
+ * Add new placeholders here, they all begin with '@'.
+ */
+static const Placeholder placeholders[] = {
+	PLACEHOLDER("@extschema@", TEMPLATE_EXTSCHEMA),
+	PLACEHOLDER("@current_user@", TEMPLATE_CURRENT_USER),
+	PLACEHOLDER("@database_owner@", TEMPLATE_DATABASE_OWNER),
+	PLACEHOLDER("@database@", TEMPLATE_DATABASE),
+	PLACEHOLDER("@extversion@", TEMPLATE_EXTVERSION)
+};
+
+static bool template_callbacks_registered = false;
+
+static Oid	cached_user_oid = InvalidOid;
+static NameData cached_user_name;
+
+static bool cached_database_valid = false;
+static NameData cached_database_name;
+static bool cached_database_has_owner = false;
+static NameData cached_database_owner;
+
+static void
+template_syscache_callback(Datum arg, int cacheid, uint32 hashvalue)
+{
+	/* role renames impact both the current user and the database owner */
+	if (cacheid == AUTHOID)
+		cached_user_oid = InvalidOid;
+
+	cached_database_valid = false;
+}
+
+static void
+register_template_callbacks(void)
+{
+	if (template_callbacks_registered)
+		return;
+
+	CacheRegisterSyscacheCallback(AUTHOID,
+								  template_syscache_callback,
+								  (Datum) 0);
+	CacheRegisterSyscacheCallback(DATABASEOID,
+								  template_syscache_callback,
+								  (Datum) 0);
+
+	template_callbacks_registered = true;
+}
+
+static const char *
+get_cached_user_name(Oid roleid)
+{
+	if (cached_user_oid != roleid)
+	{
+		char	   *name = GetUserNameFromId(roleid
+#if PG_MAJOR_VERSION >= 905
+											 , false
+#endif
+			);
+
+		namestrcpy(&cached_user_name, name);
+		pfree(name);
+		cached_user_oid = roleid;
+	}
+	return NameStr(cached_user_name);
+}
+
+/*
+ * Fetch the current database name and owner name:
+ *
+ * select datname, rolname
+ *   from pg_roles u join pg_database d on d.datdba = u.oid
+ *  where datname = current_database();
+ */
+static void
+lookup_current_database(void)
+{
+	HeapTuple	dbtuple;
+
+	if (cached_database_valid)
+		return;
+
+	cached_database_has_owner = false;
+
+	dbtuple = SearchSysCache1(DATABASEOID, ObjectIdGetDatum(MyDatabaseId));
+	if (HeapTupleIsValid(dbtuple))
+	{
+		Form_pg_database dbform = (Form_pg_database) GETSTRUCT(dbtuple);
+		Oid			owner = dbform->datdba;
+		char	   *owner_name;
+
+		namestrcpy(&cached_database_name, NameStr(dbform->datname));
+		ReleaseSysCache(dbtuple);
+
+		owner_name = GetUserNameFromId(owner
+#if PG_MAJOR_VERSION >= 905
+									   , false
+#endif
+			);
+		namestrcpy(&cached_database_owner, owner_name);
+		pfree(owner_name);
+
+		cached_database_has_owner = true;
+	}
+	else
+		namestrcpy(&cached_database_name, "");
+
+	cached_database_valid = true;
+}
+
+/*
+ * Compute the values to use when expanding a script template.  NULL values
+ * expand to the empty string.
+ */
+void
+fill_in_template_values(const char **values,
+						const char *schemaName,
+						const char *version)
+{
+	register_template_callbacks();
+	lookup_current_database();
+
+	values[TEMPLATE_EXTSCHEMA] = quote_identifier(schemaName);
+	values[TEMPLATE_CURRENT_USER] = get_cached_user_name(GetUserId());
+	values[TEMPLATE_DATABASE_OWNER] =
+		cached_database_has_owner ? NameStr(cached_database_owner) : NULL;
+	values[TEMPLATE_DATABASE] = NameStr(cached_database_name);
+	values[TEMPLATE_EXTVERSION] = version;
+	values[TEMPLATE_STANDARD_STRINGS] =
+		standard_conforming_strings ? "on" : "off";
+}
+
+/*
+ * Return a copy of the src script where lines beginning with "\echo" are
+ * reduced to empty, and placeholders are replaced by their values.  When
+ * none of that applies, return NULL rather than a copy of the script.
+ *
+ * Removing the "\echo" lines allows scripts to contain messages telling
+ * people not to run them via psql, which has been found to be necessary
+ * due to old habits.
+ */
+char *
+expand_script_template(const char *src, size_t len, const char **values)
+{
+	StringInfoData buf;
+	bool		changed = false;
+	const char *p = src;
+	const char *end = src + len;
+	const char *pending = src;	/* text not copied yet */
+
+#define FLUSH_PENDING(upto)									\
+	do {														\
+		if (!changed)											\
+		{														\
+			initStringInfo(&buf);								\
+			enlargeStringInfo(&buf, len);						\
+			changed = true;										\
+		}														\
+		appendBinaryStringInfo(&buf, pending, (upto) - pending);	\
+	} while (0)
+
+	/* we are at the beginning of a line at each iteration */
+	while (p < end)
+	{
+		const char *eol = memchr(p, '\n', end - p);
+		const char *line_end = eol ? eol : end;
+
+		if (line_end - p >= 5 && memcmp(p, "\\echo", 5) == 0)
+		{
+			/* skip the line, keeping its newline */
+			FLUSH_PENDING(p);
+			pending = line_end;
+		}
+		else
+		{
+			const char *at = p;
+
+			while ((at = memchr(at, '@', line_end - at)) != NULL)
+			{
+				int			i;
+				bool		found = false;
+
+				for (i = 0; i < lengthof(placeholders); i++)
+				{
+					const Placeholder *ph = &placeholders[i];
+
+					if (line_end - at >= ph->len
+						&& memcmp(at, ph->name, ph->len) == 0)
+					{
+						FLUSH_PENDING(at);
+						if (values[ph->value])
+							appendStringInfoString(&buf, values[ph->value]);
+						at += ph->len;
+						pending = at;
+						found = true;
+						break;
+					}
+				}
+
+				if (!found)
+					at++;
+			}
+		}
+		p = eol ? eol + 1 : end;
+	}
+
+	if (!changed)
+		return NULL;
+
+	FLUSH_PENDING(end);
+
+#undef FLUSH_PENDING
+
+	return buf.data;
+}
@@ -0,0 +1,36 @@
+/* PostgreSQL Extension WhiteList -- Dimitri Fontaine
+ *
+ * Author: Dimitri Fontaine <dimitri@2ndQuadrant.fr>
+ * Licence: PostgreSQL
+ * Copyright Dimitri Fontaine, 2011-2013
+ *
+ * For a description of the features see the README.md file from the same
+ * distribution.
+ */
+
+#ifndef __TEMPLATE_H__
+#define __TEMPLATE_H__
+
+/*
+ * Values used in the templating of the custom scripts, which are also part
+ * of the script cache key.
+ */
+typedef enum TemplateValue
+{
+	TEMPLATE_EXTSCHEMA,
+	TEMPLATE_CURRENT_USER,
+	TEMPLATE_DATABASE_OWNER,
+	TEMPLATE_DATABASE,
+	TEMPLATE_EXTVERSION,
+	TEMPLATE_STANDARD_STRINGS,	/* no placeholder, changes how we parse */
+	TEMPLATE_NVALUES
+} TemplateValue;
+
+void fill_in_template_values(const char **values,
+							 const char *schemaName,
+							 const char *version);
+
+char *expand_script_template(const char *src, size_t len,
+							 const char **values);
+
+#endif
@@ -0,0 +1 @@
+COMMENT ON EXTENSION hstore IS 'updated from 1.5 to 1.6';
@@ -0,0 +1 @@
+COMMENT ON EXTENSION hstore IS 'updated with custom scripts';
@@ -0,0 +1 @@
+COMMENT ON EXTENSION refint IS 'installed with custom scripts';
@@ -0,0 +1 @@
+COMMENT ON EXTENSION refint IS 'updated with custom scripts';
@@ -0,0 +1,58 @@
+/* PostgreSQL Extension WhiteList -- Dimitri Fontaine
+ *
+ * Author: Dimitri Fontaine <dimitri@2ndQuadrant.fr>
+ * Licence: PostgreSQL
+ * Copyright Dimitri Fontaine, 2011-2013
+ *
+ * For a description of the features see the README.md file from the same
+ * distribution.
+ */
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+/*
+ * Static tracepoints, see pgextwlist_probes.d for their definition.  Unless
+ * built with make PGEXTWLIST_DTRACE=1, they compile to nothing.
+ *
+ *  hook__start(tag), hook__done(tag)
+ *      around the processing of an extension command, given its node tag
+ *
+ *  privileged__start(extname, action), privileged__done(extname, action)
+ *      while running as the bootstrap superuser, extname is NULL for DROP
+ *
+ *  script__lookup(filename, found)
+ *      for each custom script we look for
+ *
+ *  statement__start(filename, n), statement__done(filename, n)
+ *      around the execution of each statement of a custom script
+ */
+#ifdef PGEXTWLIST_DTRACE
+
+#include "pgextwlist_probes.h"
+
+#else
+
+#define PGEXTWLIST_HOOK_START(INT1) do {} while (0)
+#define PGEXTWLIST_HOOK_DONE(INT1) do {} while (0)
+#define PGEXTWLIST_PRIVILEGED_START(STR1, STR2) do {} while (0)
+#define PGEXTWLIST_PRIVILEGED_DONE(STR1, STR2) do {} while (0)
+#define PGEXTWLIST_SCRIPT_LOOKUP(STR1, INT1) do {} while (0)
+#define PGEXTWLIST_STATEMENT_START(STR1, INT1) do {} while (0)
+#define PGEXTWLIST_STATEMENT_DONE(STR1, INT1) do {} while (0)
+
+#endif
+
+/*
+ * Wait events, reported in pg_stat_activity while we read files.
+ */
+typedef enum ExtwlistWaitEvent
+{
+	EXTWLIST_WAIT_SCRIPT_READ,
+	EXTWLIST_WAIT_CONTROL_READ
+} ExtwlistWaitEvent;
+
+void extwlist_wait_start(ExtwlistWaitEvent event);
+void extwlist_wait_end(void);
+
+#endif
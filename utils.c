@@ -23,6 +23,10 @@
 
 #include "pgextwlist.h"
 #include "utils.h"
+#include "control.h"
+#include "scriptcache.h"
+#include "template.h"
+#include "trace.h"
 
 #if PG_MAJOR_VERSION >= 903
 #include "access/htup_details.h"
@@ -36,13 +40,15 @@
 #include "access/xact.h"
 #include "catalog/indexing.h"
 #include "catalog/namespace.h"
-#include "catalog/pg_collation.h"
-#include "catalog/pg_database.h"
 #include "catalog/pg_extension.h"
 #include "commands/extension.h"
 #include "executor/executor.h"
+#include "funcapi.h"
 #include "mb/pg_wchar.h"
 #include "miscadmin.h"
+#if PG_MAJOR_VERSION >= 1000 && PG_MAJOR_VERSION < 1400
+#include "pgstat.h"
+#endif
 #include "storage/fd.h"
 #include "tcop/pquery.h"
 #include "tcop/utility.h"
@@ -53,6 +59,9 @@
 #include "utils/rel.h"
 #include "utils/snapmgr.h"
 #include "utils/syscache.h"
+#if PG_MAJOR_VERSION >= 1400
+#include "utils/wait_event.h"
+#endif
 #if PG_MAJOR_VERSION < 1200
 #include "utils/tqual.h"
 #define table_open(r, l) heap_open(r, l)
@@ -60,70 +69,15 @@
 #endif
 
 /*
- * Parse contents of primary or auxiliary control file, and fill in
- * fields of *control.	We parse primary file if version == NULL,
- * else the optional auxiliary file for that version.
- *
- * Control files are supposed to be very short, half a dozen lines,
- * so we don't worry about memory allocation risks here.  Also we don't
- * worry about what encoding it's in; all values are expected to be ASCII.
+ * Starting with 12 the core scanner can be given our own keyword tokens,
+ * which we use to split big scripts into statements.
  */
-static void
-parse_default_version_in_control_file(const char *extname,
-									  char **version,
-									  char **schema)
-{
-	char		sharepath[MAXPGPATH];
-	char	   *filename;
-	FILE	   *file;
-	ConfigVariable *item,
-		*head = NULL,
-		*tail = NULL;
-
-	/*
-	 * Locate the file to read.
-	 */
-	get_share_path(my_exec_path, sharepath);
-	filename = (char *) palloc(MAXPGPATH);
-	snprintf(filename, MAXPGPATH, "%s/extension/%s.control", sharepath, extname);
-
-	if ((file = AllocateFile(filename, "r")) == NULL)
-	{
-        /* we still need to handle the following error here */
-		ereport(ERROR,
-				(errcode_for_file_access(),
-				 errmsg("could not open extension control file \"%s\": %m",
-						filename)));
-	}
-
-	/*
-	 * Parse the file content, using GUC's file parsing code.  We need not
-	 * check the return value since any errors will be thrown at ERROR level.
-	 */
-	(void) ParseConfigFp(file, filename, 0, ERROR, &head, &tail);
-
-	FreeFile(file);
-
-	/*
-	 * Convert the ConfigVariable list into ExtensionControlFile entries, we
-	 * are only interested into the default version.
-	 */
-	for (item = head; item != NULL; item = item->next)
-	{
-		if (*version == NULL && strcmp(item->name, "default_version") == 0)
-		{
-			*version = pstrdup(item->value);
-		}
-		else if (*schema == NULL && strcmp(item->name, "schema") == 0)
-		{
-			*schema = pstrdup(item->value);
-		}
-	}
-
-	FreeConfigVariables(head);
-
-	pfree(filename);
-}
+#if PG_MAJOR_VERSION >= 1200
+#include "common/keywords.h"
+#include "parser/scanner.h"
+#define USE_SCRIPT_STREAMING
+#define SCRIPT_KEYWORD_TOKEN 65000
+#endif
 
 /*
  * We lookup scripts at the following places and run them when they exist:
@@ -273,8 +227,16 @@ fill_in_extension_properties(const char *extname,
 		*new_version = strVal(d_new_version->arg);
 
 	if (*new_version == NULL || *schema == NULL)
+	{
 		/* fetch the default_version from the extension's control file */
-		parse_default_version_in_control_file(extname, new_version, schema);
+		ExtensionControl *control = get_extension_control(extname);
+
+		if (*new_version == NULL && control->default_version)
+			*new_version = pstrdup(control->default_version);
+
+		if (*schema == NULL && control->schema)
+			*schema = pstrdup(control->schema);
+	}
 
 	/* schema might be given neither in the statement nor the control file */
 	if (*schema == NULL)
@@ -302,19 +264,68 @@ fill_in_extension_properties(const char *extname,
 }
 
 /*
- * Read an SQL script file into a string, and convert to database encoding
+ * A custom script, as read from disk: data is palloc'ed and NUL terminated.
  */
-static char *
-read_custom_script_file(const char *filename)
+typedef struct ScriptFile
+{
+	char	   *data;
+	size_t		len;
+} ScriptFile;
+
+/*
+ * Return the length of the all-ASCII prefix of given string, looking at it
+ * a word at a time.  NUL bytes are not accepted, as the multibyte verifier
+ * rejects them.
+ */
+static size_t
+ascii_prefix_length(const char *s, size_t len)
+{
+	size_t		i = 0;
+
+	for (; i + sizeof(uint64) <= len; i += sizeof(uint64))
+	{
+		uint64		chunk;
+
+		memcpy(&chunk, s + i, sizeof(chunk));
+
+		/* any high bit set, or any zero byte */
+		if ((chunk & UINT64CONST(0x8080808080808080)) != 0
+			|| ((chunk - UINT64CONST(0x0101010101010101)) & ~chunk
+				& UINT64CONST(0x8080808080808080)) != 0)
+			break;
+	}
+
+	for (; i < len; i++)
+	{
+		unsigned char c = (unsigned char) s[i];
+
+		if (c == '\0' || IS_HIGHBIT_SET(c))
+			break;
+	}
+	return i;
+}
+
+/*
+ * Read an SQL script file, and check that it's valid in the database
+ * encoding, which is the encoding we expect the custom scripts to use.
+ *
+ * The script is read in a single buffer, NUL terminated.  We don't map the
+ * file: it may be changed while we use it, and a mapping of a truncated file
+ * faults, while a mapping of a file that grew has no terminator.  We read
+ * at most the size we found, the parser never looks past our terminator.
+ *
+ * The caller is responsible for calling release_custom_script_file(), also
+ * in case of errors.
+ */
+static void
+read_custom_script_file(const char *filename, ScriptFile *script)
 {
-	int			src_encoding, dest_encoding = GetDatabaseEncoding();
-	bytea	   *content;
-	char	   *src_str;
-	char	   *dest_str;
-	int			len;
 	FILE	   *fp;
 	struct stat fst;
-	size_t	    nbytes;
+	size_t		prefix;
+	size_t		nbytes;
+
+	extwlist_wait_start(EXTWLIST_WAIT_SCRIPT_READ);
 
 	/* read_binary_file was made static in 9.5 so we'll reimplement the logic here */
 	if ((fp = AllocateFile(filename, PG_BINARY_R)) == NULL)
@@ -329,227 +340,475 @@ read_custom_script_file(const char *filename)
 			 errmsg("could not stat file \"%s\" %m",
 					filename)));
 
-	content = (bytea *) palloc((Size) fst.st_size + VARHDRSZ);
-	nbytes = fread(VARDATA(content), 1, (size_t) fst.st_size, fp);
+	script->data = (char *) palloc((Size) fst.st_size + 1);
+	nbytes = fread(script->data, 1, (size_t) fst.st_size, fp);
 
 	if (ferror(fp))
 		ereport(ERROR,
 				(errcode_for_file_access(),
 				 errmsg("could not read file \"%s\": %m", filename)));
 
-	FreeFile(fp);
-	SET_VARSIZE(content, nbytes + VARHDRSZ);
+	/* the file might have been truncated since fstat() */
+	script->data[nbytes] = '\0';
+	script->len = nbytes;
 
-	/* use database encoding */
-	src_encoding = dest_encoding;
+	FreeFile(fp);
 
-	/* make sure that source string is valid in the expected encoding */
-	len = VARSIZE_ANY_EXHDR(content);
-	src_str = VARDATA_ANY(content);
-	pg_verify_mbstr_len(src_encoding, src_str, len, false);
+	/*
+	 * Make sure that the script is valid in the database encoding, only
+	 * running the multibyte verifier past the ASCII prefix.
+	 */
+	prefix = ascii_prefix_length(script->data, script->len);
 
-	/* convert the encoding to the database encoding */
-	dest_str = (char *) pg_do_encoding_conversion((unsigned char *) src_str,
-												  len,
-												  src_encoding,
-												  dest_encoding);
+	if (prefix < script->len)
+		pg_verify_mbstr_len(GetDatabaseEncoding(),
+							script->data + prefix,
+							script->len - prefix,
+							false);
 
-	/* if no conversion happened, we have to arrange for null termination */
-	if (dest_str == src_str)
-	{
-		dest_str = (char *) palloc(len + 1);
-		memcpy(dest_str, src_str, len);
-		dest_str[len] = '\0';
-	}
+	extwlist_wait_end();
+}
 
-	return dest_str;
+static void
+release_custom_script_file(ScriptFile *script)
+{
+	if (script->data)
+		pfree(script->data);
+	script->data = NULL;
 }
 
 /*
- * Execute given SQL string.
- *
- * filename is used only to report errors.
- *
- * Note: it's tempting to just use SPI to execute the string, but that does
- * not work very well.	The really serious problem is that SPI will parse,
- * analyze, and plan the whole string before executing any of it; of course
- * this fails if there are any planable statements referring to objects
- * created earlier in the script.  A lesser annoyance is that SPI insists
- * on printing the whole string as errcontext in case of any error, and that
- * could be very long.
+ * State kept while executing a script.
  */
-static void
-execute_sql_string(const char *sql, const char *filename)
+typedef struct ScriptExecState
 {
-	List	   *raw_parsetree_list;
 	DestReceiver *dest;
-	ListCell   *lc1;
-	MemoryContext temp_ctx = AllocSetContextCreate(CurrentMemoryContext,
-												   "temp_script_context",
-												   ALLOCSET_DEFAULT_SIZES);
-	MemoryContext prev_ctx = MemoryContextSwitchTo(temp_ctx);
+	MemoryContext script_ctx;
+	MemoryContext stmt_ctx;
+	Size		peak;			/* memory used, see end_of_statement() */
+	bool		snapshot_pushed;	/* by a run of catalog-only statements */
+	const char *filename;		/* for the statement probes */
+	int			nstatements;
+} ScriptExecState;
 
-	/*
-	 * Parse the SQL string into a list of raw parse trees.
-	 */
-	raw_parsetree_list = pg_parse_query(sql);
-
-	/* All output from SELECTs goes to the bit bucket */
-	dest = CreateDestReceiver(DestNone);
+#if PG_MAJOR_VERSION >= 1000
+/*
+ * Utility statements that only read and write the catalogs, which they do
+ * using catalog snapshots: they don't need an active snapshot of their own,
+ * as long as the command counter is advanced between them.  That's the bulk
+ * of the custom scripts, think GRANT.
+ *
+ * We stick to privileges, ownership, comments and security labels on the
+ * database objects: SET changes the session state that the next statements
+ * depend on, and roles live in shared catalogs.
+ */
+static bool
+is_catalog_only_statement(Node *utilityStmt)
+{
+	if (!extwlist_batch_snapshots || utilityStmt == NULL)
+		return false;
 
-	/*
-	 * Do parse analysis, rule rewrite, planning, and execution for each raw
-	 * parsetree.  We must fully execute each query before beginning parse
-	 * analysis on the next one, since there may be interdependencies.
-	 */
-	foreach(lc1, raw_parsetree_list)
+	switch (nodeTag(utilityStmt))
 	{
-#if PG_MAJOR_VERSION >= 1000
-		RawStmt	   *parsetree = lfirst_node(RawStmt, lc1);
-#else
-		Node	   *parsetree = (Node *) lfirst(lc1);
+		case T_GrantStmt:
+		case T_AlterDefaultPrivilegesStmt:
+		case T_AlterOwnerStmt:
+		case T_CommentStmt:
+		case T_SecLabelStmt:
+			return true;
+
+		default:
+			return false;
+	}
+}
 #endif
-		List	   *stmt_list;
-		ListCell   *lc2;
+
+/*
+ * Pop the snapshot shared by a run of catalog-only statements, if any.
+ */
+static void
+end_snapshot_batch(ScriptExecState *state)
+{
+	if (state->snapshot_pushed)
+	{
+		PopActiveSnapshot();
+		state->snapshot_pushed = false;
+	}
+}
+
+/*
+ * Do parse analysis, rule rewrite, planning, and execution for given raw
+ * parsetree, in the current memory context.
+ */
+static void
+execute_raw_statement(Node *parsetree, const char *sql,
+					  ScriptExecState *state)
+{
+	DestReceiver *dest = state->dest;
+	List	   *stmt_list;
+	ListCell   *lc;
 
 #if PG_MAJOR_VERSION >= 1500
-		stmt_list = pg_analyze_and_rewrite_fixedparams(parsetree,
-													   sql,
-													   NULL,
-													   0,
-													   NULL
-													   );
+	stmt_list = pg_analyze_and_rewrite_fixedparams((RawStmt *) parsetree,
+												   sql,
+												   NULL,
+												   0,
+												   NULL
+												   );
+#elif PG_MAJOR_VERSION >= 1000
+	stmt_list = pg_analyze_and_rewrite((RawStmt *) parsetree,
+									   sql,
+									   NULL,
+									   0,
+									   NULL);
 #else
-		stmt_list = pg_analyze_and_rewrite(parsetree,
-										   sql,
-										   NULL,
-										   0
-#if PG_MAJOR_VERSION >= 1000
-										   , NULL
-#endif
-										   );
+	stmt_list = pg_analyze_and_rewrite(parsetree,
+									   sql,
+									   NULL,
+									   0);
 #endif
-		stmt_list = pg_plan_queries(stmt_list,
+	stmt_list = pg_plan_queries(stmt_list,
 #if PG_MAJOR_VERSION >= 1300
-									sql,
+								sql,
 #endif
-									0,
-									NULL);
+								0,
+								NULL);
 
-		foreach(lc2, stmt_list)
-		{
+	foreach(lc, stmt_list)
+	{
 #if PG_MAJOR_VERSION >= 1000
-			PlannedStmt *stmt = lfirst_node(PlannedStmt, lc2);
+		PlannedStmt *stmt = lfirst_node(PlannedStmt, lc);
 #else
-			Node	   *stmt = (Node *) lfirst(lc2);
+		Node	   *stmt = (Node *) lfirst(lc);
 #endif
 
-			if (IsA(stmt, TransactionStmt))
-				ereport(ERROR,
-						(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-						 errmsg("transaction control statements are not allowed within an extension script")));
+		if (IsA(stmt, TransactionStmt))
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("transaction control statements are not allowed within an extension script")));
 
-			CommandCounterIncrement();
+		CommandCounterIncrement();
 
-			PushActiveSnapshot(GetTransactionSnapshot());
+		state->nstatements++;
+		PGEXTWLIST_STATEMENT_START(state->filename, state->nstatements);
 
-			if (IsA(stmt, PlannedStmt) &&
-				((PlannedStmt *) stmt)->utilityStmt == NULL)
+#if PG_MAJOR_VERSION >= 1000
+		if (is_catalog_only_statement(stmt->utilityStmt))
+		{
+			/*
+			 * Share a single snapshot with the previous catalog-only
+			 * statements, as PortalRunMulti() does, making sure it sees
+			 * what they did.
+			 */
+			if (state->snapshot_pushed)
+				UpdateActiveSnapshotCommandId();
+			else
 			{
-				QueryDesc  *qdesc;
+				PushActiveSnapshot(GetTransactionSnapshot());
+				state->snapshot_pushed = true;
+			}
 
-				qdesc = CreateQueryDesc((PlannedStmt *) stmt,
+			ProcessUtility(stmt,
+						   sql,
+#if PG_MAJOR_VERSION >= 1400
+						   false,		/* no need to copy */
+#endif
+						   PROCESS_UTILITY_QUERY,
+						   NULL,
+						   NULL,
+						   dest,
+						   NULL);
+
+			PGEXTWLIST_STATEMENT_DONE(state->filename, state->nstatements);
+			continue;
+		}
+#endif
+
+		end_snapshot_batch(state);
+
+		PushActiveSnapshot(GetTransactionSnapshot());
+
+		if (IsA(stmt, PlannedStmt) &&
+			((PlannedStmt *) stmt)->utilityStmt == NULL)
+		{
+			QueryDesc  *qdesc;
+
+			qdesc = CreateQueryDesc((PlannedStmt *) stmt,
 #if PG_MAJOR_VERSION >= 1800
-										NULL,
+									NULL,
 #endif
-										sql,
-										GetActiveSnapshot(), NULL,
-										dest, NULL,
+									sql,
+									GetActiveSnapshot(), NULL,
+									dest, NULL,
 #if PG_MAJOR_VERSION >= 1000
-										NULL,
+									NULL,
 #endif
-										0);
+									0);
 
-				ExecutorStart(qdesc, 0);
-				ExecutorRun(qdesc, ForwardScanDirection, 0
+			ExecutorStart(qdesc, 0);
+			ExecutorRun(qdesc, ForwardScanDirection, 0
 #if PG_MAJOR_VERSION >= 1000 && PG_MAJOR_VERSION < 1800
-					, true
+				, true
 #endif
-				);
-				ExecutorFinish(qdesc);
-				ExecutorEnd(qdesc);
+			);
+			ExecutorFinish(qdesc);
+			ExecutorEnd(qdesc);
 
-				FreeQueryDesc(qdesc);
-			}
-			else
-			{
-				ProcessUtility(stmt,
-							   sql,
+			FreeQueryDesc(qdesc);
+		}
+		else
+		{
+			ProcessUtility(stmt,
+						   sql,
 #if PG_MAJOR_VERSION >= 1400
-							   false,		/* no need to copy */
+						   false,		/* no need to copy */
 #endif
 #if PG_MAJOR_VERSION >= 903
-							   PROCESS_UTILITY_QUERY,
+						   PROCESS_UTILITY_QUERY,
 #endif
-							   NULL,
+						   NULL,
 #if PG_MAJOR_VERSION >= 1000
-							   NULL,
+						   NULL,
 #endif
 #if PG_MAJOR_VERSION < 903
-							   false,		/* not top level */
+						   false,		/* not top level */
 #endif
-							   dest,
-							   NULL);
+						   dest,
+						   NULL);
+		}
+
+		PopActiveSnapshot();
+
+		PGEXTWLIST_STATEMENT_DONE(state->filename, state->nstatements);
+	}
+}
+
+/*
+ * Keep track of the memory used by a script, before resetting the memory
+ * context of the statement that just ran.
+ */
+static void
+end_of_statement(ScriptExecState *state)
+{
+#if PG_MAJOR_VERSION >= 1300
+	Size		used = MemoryContextMemAllocated(state->script_ctx, true);
+
+	if (used > state->peak)
+		state->peak = used;
+#endif
+
+	MemoryContextReset(state->stmt_ctx);
+}
+
+#ifdef USE_SCRIPT_STREAMING
+/*
+ * Execute the given SQL script one statement at a time, as we find them.
+ *
+ * We use the core scanner to find the semicolons that end statements, and
+ * parse each statement's text separately.  Semicolons found in the body of
+ * a BEGIN ATOMIC ... END function do not end the statement: in there, the
+ * only other use of the END keyword is to close a CASE expression.
+ *
+ * The scanner allocates memory for some tokens, we make sure that happens
+ * in the statement's memory context, which we reset after each statement.
+ * It also copies the whole script into its scan buffer, so that we still
+ * use twice the size of the script, only not the size of all of its parse
+ * trees: the core scanner can't be fed the script a chunk at a time.
+ */
+static void
+execute_sql_stream(const char *sql, ScriptExecState *state)
+{
+	core_yyscan_t yyscanner;
+	core_yy_extra_type yyextra;
+	uint16	   *keyword_tokens;
+	int			i;
+	int			start = 0;		/* of the current statement */
+	bool		has_tokens = false;
+	bool		after_begin = false;
+	int			atomic_depth = 0;
+
+	/* we only need to know that a token is a keyword, not which one */
+	keyword_tokens = (uint16 *) palloc(ScanKeywords.num_keywords * sizeof(uint16));
+	for (i = 0; i < ScanKeywords.num_keywords; i++)
+		keyword_tokens[i] = SCRIPT_KEYWORD_TOKEN;
+
+	yyscanner = scanner_init(sql, &yyextra, &ScanKeywords, keyword_tokens);
+
+	for (;;)
+	{
+		core_YYSTYPE lval;
+		YYLTYPE		lloc;
+		int			token;
+
+		MemoryContextSwitchTo(state->stmt_ctx);
+		token = core_yylex(&lval, &lloc, yyscanner);
+		MemoryContextSwitchTo(state->script_ctx);
+
+		if (token == 0 || (token == ';' && atomic_depth == 0))
+		{
+			if (has_tokens)
+			{
+				int			stop = token == 0 ? strlen(sql) : lloc + 1;
+				char	   *stmt;
+				List	   *raw_parsetree_list;
+				ListCell   *lc;
+
+				MemoryContextSwitchTo(state->stmt_ctx);
+
+				stmt = pnstrdup(sql + start, stop - start);
+				raw_parsetree_list = pg_parse_query(stmt);
+
+				foreach(lc, raw_parsetree_list)
+					execute_raw_statement((Node *) lfirst(lc), stmt, state);
+
+				MemoryContextSwitchTo(state->script_ctx);
 			}
+			end_of_statement(state);
 
-			PopActiveSnapshot();
+			if (token == 0)
+				break;
+
+			start = lloc + 1;
+			has_tokens = false;
+			after_begin = false;
+			continue;
 		}
+
+		has_tokens = true;
+
+		if (token == SCRIPT_KEYWORD_TOKEN)
+		{
+			if (atomic_depth == 0)
+			{
+				if (after_begin && strcmp(lval.keyword, "atomic") == 0)
+					atomic_depth = 1;
+			}
+			else if (strcmp(lval.keyword, "case") == 0)
+				atomic_depth++;
+			else if (strcmp(lval.keyword, "end") == 0)
+				atomic_depth--;
+
+			after_begin = strcmp(lval.keyword, "begin") == 0;
+		}
+		else
+			after_begin = false;
 	}
 
-	/* Be sure to advance the command counter after the last script command */
-	CommandCounterIncrement();
-	MemoryContextSwitchTo(prev_ctx);
-	MemoryContextDelete(temp_ctx);
+	scanner_finish(yyscanner);
 }
+#endif							/* USE_SCRIPT_STREAMING */
 
 /*
- * get_current_database_owner_name
+ * Execute given SQL string, either already parsed into raw_parsetree_list,
+ * or to be parsed a statement at a time when raw_parsetree_list is NIL.
+ *
+ * filename is used only to report errors.
+ *
+ * Note: it's tempting to just use SPI to execute the string, but that does
+ * not work very well.	The really serious problem is that SPI will parse,
+ * analyze, and plan the whole string before executing any of it; of course
+ * this fails if there are any planable statements referring to objects
+ * created earlier in the script.  A lesser annoyance is that SPI insists
+ * on printing the whole string as errcontext in case of any error, and that
+ * could be very long.
  *
- * select rolname
- *   from pg_roles u join pg_database d on d.datdba = u.oid
- *  where datname = current_database();
+ * Each statement runs in its own memory context, reset before running the
+ * next one, so that the parse trees, plans and executor states don't add up
+ * over the script.  The text of the script is kept in memory all along.
  */
-static char *
-get_current_database_owner_name()
+static void
+execute_sql_string(const char *sql, List *raw_parsetree_list,
+				   const char *filename)
 {
-	HeapTuple	dbtuple;
-	Oid         owner;
+	ScriptExecState state;
+	ListCell   *lc1;
+	MemoryContext prev_ctx = CurrentMemoryContext;
+
+	state.script_ctx = AllocSetContextCreate(CurrentMemoryContext,
+											 "temp_script_context",
+											 ALLOCSET_DEFAULT_SIZES);
+	state.stmt_ctx = AllocSetContextCreate(state.script_ctx,
+										   "temp_statement_context",
+										   ALLOCSET_DEFAULT_SIZES);
+	state.peak = 0;
+	state.snapshot_pushed = false;
+	state.filename = filename;
+	state.nstatements = 0;
+
+	MemoryContextSwitchTo(state.script_ctx);
 
-	dbtuple = SearchSysCache1(DATABASEOID, MyDatabaseId);
-	if (HeapTupleIsValid(dbtuple))
+	/* All output from SELECTs goes to the bit bucket */
+	state.dest = CreateDestReceiver(DestNone);
+
+#ifdef USE_SCRIPT_STREAMING
+	if (raw_parsetree_list == NIL)
+		execute_sql_stream(sql, &state);
+#else
+	if (raw_parsetree_list == NIL)
+		raw_parsetree_list = pg_parse_query(sql);
+#endif
+
+	/*
+	 * Do parse analysis, rule rewrite, planning, and execution for each raw
+	 * parsetree.  We must fully execute each query before beginning parse
+	 * analysis on the next one, since there may be interdependencies.
+	 */
+	foreach(lc1, raw_parsetree_list)
 	{
-		owner = ((Form_pg_database) GETSTRUCT(dbtuple))->datdba;
-		ReleaseSysCache(dbtuple);
+		MemoryContextSwitchTo(state.stmt_ctx);
+		execute_raw_statement((Node *) lfirst(lc1), sql, &state);
+		MemoryContextSwitchTo(state.script_ctx);
+
+		end_of_statement(&state);
 	}
-	else
-		return NULL;
 
-	return GetUserNameFromId(owner
-#if PG_MAJOR_VERSION >= 905
-							, false
+	end_snapshot_batch(&state);
+
+	/* Be sure to advance the command counter after the last script command */
+	CommandCounterIncrement();
+
+#if PG_MAJOR_VERSION >= 1300
+	elog(DEBUG1, "Custom script \"%s\" used at most " UINT64_FORMAT " bytes of memory",
+		 filename, (uint64) state.peak);
 #endif
-	);
+
+	MemoryContextSwitchTo(prev_ctx);
+	MemoryContextDelete(state.script_ctx);
+}
+
+/*
+ * Read given custom script and apply the templating to it.  The result
+ * might be the script file's buffer, otherwise that buffer is released
+ * right away, so that we only ever keep one copy of the script.
+ */
+static const char *
+load_custom_script(const char *filename, const char **values,
+				   ScriptFile *script)
+{
+	char	   *expanded;
+
+	read_custom_script_file(filename, script);
+
+	expanded = expand_script_template(script->data, script->len, values);
+
+	if (expanded == NULL)
+		return script->data;
+
+	release_custom_script_file(script);
+	return expanded;
 }
 
 /*
  * Execute given script
  */
 void
-execute_custom_script(const char *filename, const char *schemaName)
+execute_custom_script(const char *filename,
+					  const char *schemaName,
+					  const char *version)
 {
 	int			save_nestlevel;
 	StringInfoData pathbuf;
-	const char *qSchemaName = quote_identifier(schemaName);
+	ScriptFile	script;
 
 	elog(DEBUG1, "Executing custom script \"%s\"", filename);
 
@@ -611,72 +870,125 @@ execute_custom_script(const char *filename, const char *schemaName)
 #endif
 		);
 
+	MemSet(&script, 0, sizeof(script));
+
 	PG_TRY();
 	{
-		char	   *c_sql = read_custom_script_file(filename);
-		Datum		t_sql;
-
-		/* We use various functions that want to operate on text datums */
-		t_sql = CStringGetTextDatum(c_sql);
+		const char *values[TEMPLATE_NVALUES];
+		ScriptFileId fileid;
+		const char *c_sql;
+		char	   *cached_sql;
+		List	   *raw_parsetree_list;
 
-		/*
-		 * Reduce any lines beginning with "\echo" to empty.  This allows
-		 * scripts to contain messages telling people not to run them via
-		 * psql, which has been found to be necessary due to old habits.
-		 */
-		t_sql = DirectFunctionCall4Coll(textregexreplace,
-										C_COLLATION_OID,
-										t_sql,
-										CStringGetTextDatum("^\\\\echo.*$"),
-										CStringGetTextDatum(""),
-										CStringGetTextDatum("ng"));
+		fill_in_template_values(values, schemaName, version);
 
-		/*
-		 * substitute the target schema name for occurrences of @extschema@.
-		 */
-		t_sql = DirectFunctionCall3Coll(replace_text,
-									C_COLLATION_OID,
-									t_sql,
-									CStringGetTextDatum("@extschema@"),
-									CStringGetTextDatum(qSchemaName));
-
-		/*
-		 * substitute the current user name for occurrences of @current_user@
-		 */
-		t_sql = DirectFunctionCall3Coll(replace_text,
-									C_COLLATION_OID,
-									t_sql,
-									CStringGetTextDatum("@current_user@"),
-									CStringGetTextDatum(
-										GetUserNameFromId(GetUserId()
-#if PG_MAJOR_VERSION >= 905
-														  , false
-#endif
-										)));
+		if (script_cache_lookup(filename, values, lengthof(values),
+								&fileid, &cached_sql, &raw_parsetree_list))
+			c_sql = cached_sql;
+		else
+		{
+			c_sql = load_custom_script(filename, values, &script);
 
-		/*
-		 * substitute the database owner for occurrences of @database_owner@
-		 */
-		t_sql = DirectFunctionCall3Coll(replace_text,
-									C_COLLATION_OID,
-									t_sql,
-									CStringGetTextDatum("@database_owner@"),
-									CStringGetTextDatum(
-										get_current_database_owner_name()));
+			/*
+			 * Scripts too big for the cache are parsed a statement at a
+			 * time while executing them, see execute_sql_string().
+			 */
+			if (script_cache_would_keep(strlen(c_sql)))
+			{
+				raw_parsetree_list = pg_parse_query(c_sql);
 
-		/* And now back to C string */
-		c_sql = text_to_cstring(DatumGetTextPP(t_sql));
+				script_cache_store(filename, values, lengthof(values),
+								   &fileid, c_sql, raw_parsetree_list);
+			}
+			else
+				raw_parsetree_list = NIL;
+		}
 
-		execute_sql_string(c_sql, filename);
+		execute_sql_string(c_sql, raw_parsetree_list, filename);
 	}
 	PG_CATCH();
 	{
+		release_custom_script_file(&script);
 		PG_RE_THROW();
 	}
 	PG_END_TRY();
 
+	release_custom_script_file(&script);
+
 	/*
 	 * Restore the GUC variables we set above.
 	 */
 	AtEOXact_GUC(true, save_nestlevel);
 }
+
+#if PG_MAJOR_VERSION >= 1700
+static const char *const extwlist_wait_event_names[] = {
+	"ExtwlistScriptRead",
+	"ExtwlistControlRead"
+};
+
+static uint32 extwlist_wait_events[lengthof(extwlist_wait_event_names)];
+#endif
+
+/*
+ * Report that we are waiting on given event, named in pg_stat_activity from
+ * 17 on.  Before that, the wait event shows up as just "Extension".
+ */
+void
+extwlist_wait_start(ExtwlistWaitEvent event)
+{
+#if PG_MAJOR_VERSION >= 1700
+	if (extwlist_wait_events[event] == 0)
+		extwlist_wait_events[event] =
+			WaitEventExtensionNew(extwlist_wait_event_names[event]);
+
+	pgstat_report_wait_start(extwlist_wait_events[event]);
+#elif PG_MAJOR_VERSION >= 1000
+	pgstat_report_wait_start(PG_WAIT_EXTENSION);
+#endif
+}
+
+void
+extwlist_wait_end(void)
+{
+#if PG_MAJOR_VERSION >= 1000
+	pgstat_report_wait_end();
+#endif
+}
+
+/*
+ * Prepare a set returning function to return its result in a tuplestore,
+ * and return it along with the expected tuple descriptor.
+ */
+Tuplestorestate *
+materialize_srf_result(FunctionCallInfo fcinfo, TupleDesc *tupdesc)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	Tuplestorestate *tupstore;
+	MemoryContext oldcontext;
+
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not allowed in this context")));
+
+	if (get_call_result_type(fcinfo, NULL, tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	oldcontext = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+
+	*tupdesc = CreateTupleDescCopy(*tupdesc);
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = *tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	return tupstore;
+}
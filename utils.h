@@ -13,11 +13,13 @@
 
 #include "utils/builtins.h"
 #include "nodes/pg_list.h"
+#include "utils/tuplestore.h"
 
 #define MAXPGPATH 1024
 
 extern char *extwlist_extensions;
 extern char *extwlist_custom_path;
+extern bool extwlist_batch_snapshots;
 
 char *get_specific_custom_script_filename(const char *name,
 										  const char *when,
@@ -36,6 +38,11 @@ void fill_in_extension_properties(const char *extname,
 								  char **old_version,
 								  char **new_version);
 
-void execute_custom_script(const char *schemaName, const char *filename);
+void execute_custom_script(const char *filename,
+						   const char *schemaName,
+						   const char *version);
+
+Tuplestorestate *materialize_srf_result(FunctionCallInfo fcinfo,
+										TupleDesc *tupdesc);
 
 #endif
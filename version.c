@@ -0,0 +1,232 @@
+/* PostgreSQL Extension WhiteList -- Dimitri Fontaine
+ *
+ * Author: Dimitri Fontaine <dimitri@2ndQuadrant.fr>
+ * Licence: PostgreSQL
+ * Copyright Dimitri Fontaine, 2011-2013
+ *
+ * For a description of the features see the README.md file from the same
+ * distribution.
+ */
+
+/*
+ * Version constraints of whitelist entries, such as ">=3.3" or "=1.8".
+ *
+ * Extension versions are free-form strings, which we compare part by part:
+ * numbers numerically, runs of letters case insensitively, and a number
+ * sorts after letters so that "1.0" is newer than "1.0beta1".  Missing
+ * trailing numbers count as zeroes, "4" being the same as "4.0".
+ *
+ * Constraints are compiled once, when the setting changes.  Checking a
+ * version then reads it only once, and allocates nothing.
+ */
+
+#include <ctype.h>
+#include "postgres.h"
+
+#include "pgextwlist.h"
+#include "version.h"
+
+/* larger numbers are clamped, that's more digits than any version has */
+#define VERSION_MAX_DIGITS	18
+
+static const struct
+{
+	const char *name;
+	VersionOp	op;
+}			version_ops[] =
+{
+	{">=", VERSION_OP_GE},
+	{"<=", VERSION_OP_LE},
+	{"!=", VERSION_OP_NE},
+	{"==", VERSION_OP_EQ},
+	{"=", VERSION_OP_EQ},
+	{"<", VERSION_OP_LT},
+	{">", VERSION_OP_GT}
+};
+
+/*
+ * Read the next part of a version, skipping separators, and tell whether
+ * there was one.
+ */
+static bool
+next_version_part(const char *version, const char **p, VersionPart *part)
+{
+	const char *s = *p;
+
+	while (*s && !isalnum((unsigned char) *s))
+		s++;
+
+	if (*s == '\0')
+	{
+		*p = s;
+		return false;
+	}
+
+	part->offset = s - version;
+
+	if (isdigit((unsigned char) *s))
+	{
+		int			ndigits = 0;
+
+		part->numeric = true;
+		part->number = 0;
+
+		for (; isdigit((unsigned char) *s); s++)
+			if (ndigits++ < VERSION_MAX_DIGITS)
+				part->number = part->number * 10 + (*s - '0');
+	}
+	else
+	{
+		part->numeric = false;
+		part->number = 0;
+
+		while (isalpha((unsigned char) *s))
+			s++;
+	}
+
+	part->len = s - version - part->offset;
+	*p = s;
+	return true;
+}
+
+bool
+is_version_constraint_start(char c)
+{
+	return c == '=' || c == '!' || c == '<' || c == '>';
+}
+
+/*
+ * Compile a constraint, an operator followed by a version.  Returns NULL, or
+ * what's wrong with it.
+ */
+const char *
+parse_version_constraint(const char *str, VersionConstraint *constraint)
+{
+	const char *p = str;
+	const char *v;
+	int			i;
+
+	MemSet(constraint, 0, sizeof(VersionConstraint));
+
+	/* two-character operators first */
+	for (i = 0; i < lengthof(version_ops); i++)
+	{
+		size_t		len = strlen(version_ops[i].name);
+
+		if (strncmp(p, version_ops[i].name, len) == 0)
+		{
+			constraint->op = version_ops[i].op;
+			p += len;
+			break;
+		}
+	}
+
+	if (i == lengthof(version_ops))
+		return "Version constraints start with one of =, !=, <, <=, > or >=.";
+
+	if (*p == '\0')
+		return "Version constraints need a version after the operator.";
+
+	if (strlen(p) >= NAMEDATALEN)
+		return "Version is too long.";
+
+	strlcpy(constraint->version, p, NAMEDATALEN);
+
+	v = constraint->version;
+	while (constraint->nparts < VERSION_MAX_PARTS
+		   && next_version_part(constraint->version, &v,
+								&constraint->parts[constraint->nparts]))
+		constraint->nparts++;
+
+	if (constraint->nparts == 0)
+		return "Versions must contain letters or digits.";
+
+	if (*v != '\0')
+		return "Version has too many parts.";
+
+	return NULL;
+}
+
+/*
+ * Compare a version with the one of a constraint, as strcmp() does.
+ */
+static int
+compare_version(const char *version, const VersionConstraint *constraint)
+{
+	const char *p = version;
+	int			i = 0;
+
+	for (;;)
+	{
+		VersionPart part;
+		const VersionPart *cpart;
+		bool		have_part = next_version_part(version, &p, &part);
+		bool		have_cpart = i < constraint->nparts;
+
+		if (!have_part && !have_cpart)
+			return 0;
+
+		cpart = have_cpart ? &constraint->parts[i++] : NULL;
+
+		/* a missing part is a zero: "4" is "4.0", and older than "4.0.1" */
+		if (!have_part)
+		{
+			if (!cpart->numeric)
+				return 1;		/* "1.0" is newer than "1.0beta" */
+			if (cpart->number != 0)
+				return -1;
+			continue;
+		}
+		if (!have_cpart)
+		{
+			if (!part.numeric)
+				return -1;
+			if (part.number != 0)
+				return 1;
+			continue;
+		}
+
+		if (part.numeric && cpart->numeric)
+		{
+			if (part.number != cpart->number)
+				return part.number < cpart->number ? -1 : 1;
+		}
+		else if (part.numeric != cpart->numeric)
+			return part.numeric ? 1 : -1;
+		else
+		{
+			int			len = Min(part.len, cpart->len);
+			int			cmp = pg_strncasecmp(version + part.offset,
+											 constraint->version + cpart->offset,
+											 len);
+
+			if (cmp != 0)
+				return cmp < 0 ? -1 : 1;
+			if (part.len != cpart->len)
+				return part.len < cpart->len ? -1 : 1;
+		}
+	}
+}
+
+bool
+version_satisfies(const char *version, const VersionConstraint *constraint)
+{
+	int			cmp = compare_version(version, constraint);
+
+	switch (constraint->op)
+	{
+		case VERSION_OP_EQ:
+			return cmp == 0;
+		case VERSION_OP_NE:
+			return cmp != 0;
+		case VERSION_OP_LT:
+			return cmp < 0;
+		case VERSION_OP_LE:
+			return cmp <= 0;
+		case VERSION_OP_GT:
+			return cmp > 0;
+		case VERSION_OP_GE:
+			return cmp >= 0;
+	}
+	return false;				/* keep compiler quiet */
+}
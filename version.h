@@ -0,0 +1,55 @@
+/* PostgreSQL Extension WhiteList -- Dimitri Fontaine
+ *
+ * Author: Dimitri Fontaine <dimitri@2ndQuadrant.fr>
+ * Licence: PostgreSQL
+ * Copyright Dimitri Fontaine, 2011-2013
+ *
+ * For a description of the features see the README.md file from the same
+ * distribution.
+ */
+
+#ifndef __VERSION_H__
+#define __VERSION_H__
+
+/* versions with more parts than that are refused in constraints */
+#define VERSION_MAX_PARTS	16
+
+typedef enum VersionOp
+{
+	VERSION_OP_EQ,
+	VERSION_OP_NE,
+	VERSION_OP_LT,
+	VERSION_OP_LE,
+	VERSION_OP_GT,
+	VERSION_OP_GE
+} VersionOp;
+
+/*
+ * A version is a list of parts, either numbers or runs of letters, so that
+ * "2.0beta1" is 2, 0, "beta", 1.  Text parts point into the version string.
+ */
+typedef struct VersionPart
+{
+	bool		numeric;
+	int64		number;
+	int			offset;			/* of the text in the version string */
+	int			len;
+} VersionPart;
+
+/*
+ * A compiled constraint, such as ">=3.3", with no pointers so that it can be
+ * copied around, as in GUC extra data.
+ */
+typedef struct VersionConstraint
+{
+	VersionOp	op;
+	int			nparts;
+	VersionPart parts[VERSION_MAX_PARTS];
+	char		version[NAMEDATALEN];
+} VersionConstraint;
+
+bool is_version_constraint_start(char c);
+const char *parse_version_constraint(const char *str, VersionConstraint *constraint);
+bool version_satisfies(const char *version, const VersionConstraint *constraint);
+
+#endif
@@ -0,0 +1,559 @@
+/* PostgreSQL Extension WhiteList -- Dimitri Fontaine
+ *
+ * Author: Dimitri Fontaine <dimitri@2ndQuadrant.fr>
+ * Licence: PostgreSQL
+ * Copyright Dimitri Fontaine, 2011-2013
+ *
+ * For a description of the features see the README.md file from the same
+ * distribution.
+ */
+
+/*
+ * Maintain the parsed version of the extwlist.extensions setting.
+ *
+ * The list is parsed only once per value change, in the GUC check hook, so
+ * that syntax errors are reported at SET time.  The check hook produces a
+ * flat array of names as its "extra" data, and the assign hook only
+ * remembers it: assign hooks must not fail, so the matcher used for lookups
+ * is (re)built lazily the first time we need it after a change.
+ *
+ * Extensions listed in extwlist.extensions_file are whitelisted too, see
+ * whitelistfile.c, and so are those in the extwlist.allowed table of the
+ * current database, see allowed.c.
+ *
+ * Names may be glob patterns, where '*' matches any sequence of characters
+ * and '?' any single one, as in "pg_*" or "postgis*", and may be followed by
+ * version constraints, as in "postgis>=3.3,<4" where the list item "<4" adds
+ * a constraint to the previous name.  Constraints are compiled by the check
+ * hook, see version.c, and checked for CREATE EXTENSION and ALTER EXTENSION
+ * UPDATE only.  All the names are compiled into a single trie, whose edges
+ * are either a character, '?' or '*', a node reached through '*' looping on
+ * any character.  Looking up a name walks the trie one character at a time,
+ * following every matching edge at once, so that its cost depends on the
+ * length of the name and the shape of the trie, not on the number of names
+ * in the list.
+ */
+
+#include <ctype.h>
+#include <stdlib.h>
+#include "postgres.h"
+
+#include "pgextwlist.h"
+#include "allowed.h"
+#include "version.h"
+#include "whitelist.h"
+#include "whitelistfile.h"
+
+#include "miscadmin.h"
+#include "utils/builtins.h"
+#include "utils/memutils.h"
+#if PG_MAJOR_VERSION >= 1000
+#include "utils/varlena.h"
+#endif
+
+typedef struct WhitelistName
+{
+	NameData	name;			/* or pattern */
+	int			first_constraint;	/* in WhitelistConstraints() */
+	int			nconstraints;	/* all of them must be satisfied */
+} WhitelistName;
+
+/*
+ * The check hook output: a single malloc'ed chunk, as required by guc.c, with
+ * the names followed by their version constraints.
+ */
+typedef struct WhitelistNames
+{
+	int			count;
+	int			nconstraints;
+	WhitelistName names[FLEXIBLE_ARRAY_MEMBER];
+} WhitelistNames;
+
+#define WhitelistConstraintsOffset(count) \
+	MAXALIGN(offsetof(WhitelistNames, names) + (count) * sizeof(WhitelistName))
+
+#define WhitelistConstraints(wn) \
+	((VersionConstraint *) ((char *) (wn) + WhitelistConstraintsOffset((wn)->count)))
+
+typedef struct TrieNode
+{
+	struct TrieNode *children;	/* first child reached with a character */
+	struct TrieNode *next;		/* next sibling in the parent's children */
+	struct TrieNode *any;		/* child reached with '?' */
+	struct TrieNode *star;		/* child reached with '*' */
+	char		label;			/* character leading to this node */
+	bool		is_star;		/* reached with '*', loops on any character */
+	int			accept;			/* first name ending here, or -1 */
+	uint32		mark;			/* last lookup step the node was active at */
+} TrieNode;
+
+/*
+ * The compiled whitelist, all of it allocated in its own memory context.
+ */
+typedef struct Whitelist
+{
+	MemoryContext context;
+	TrieNode   *nodes;			/* nodes[0] is the root */
+	int			nnodes;
+	TrieNode  **active;			/* nodes matching the name read so far */
+	TrieNode  **next;
+	uint32		step;			/* for TrieNode.mark */
+	WhitelistNames *names;		/* what we were built from */
+	int		   *next_accept;	/* next name ending at the same node */
+} Whitelist;
+
+static WhitelistNames *whitelist_names = NULL;
+static Whitelist *whitelist = NULL;
+static bool whitelist_valid = false;
+
+/*
+ * Is any item of the list too long to fit in a name?  SplitIdentifierString()
+ * would silently truncate it, and truncating the version of "name>=3.10"
+ * gives a looser "name>=3.1" constraint.  Doubled quotes count once, and
+ * blanks around the items don't count.
+ */
+static bool
+list_item_is_too_long(const char *raw)
+{
+	const char *p = raw;
+
+	while (*p)
+	{
+		int			len = 0;		/* bytes of the item read so far */
+		int			significant = 0;	/* up to the last non blank one */
+		bool		quoted = false;
+
+		while (isspace((unsigned char) *p))
+			p++;
+
+		while (*p && (quoted || *p != ','))
+		{
+			if (*p == '"')
+			{
+				if (!quoted || p[1] != '"')
+				{
+					quoted = !quoted;
+					p++;
+					continue;
+				}
+				p++;			/* a doubled quote in a quoted name */
+			}
+			len++;
+			if (quoted || !isspace((unsigned char) *p))
+				significant = len;
+			p++;
+		}
+
+		if (significant >= NAMEDATALEN)
+			return true;
+
+		if (*p == ',')
+			p++;
+	}
+	return false;
+}
+
+/*
+ * GUC check_hook for extwlist.extensions
+ */
+bool
+check_extwlist_extensions(char **newval, void **extra, GucSource source)
+{
+	char	   *rawnames = pstrdup(*newval);
+	List	   *extensions;
+	ListCell   *lc;
+	WhitelistName *names;
+	VersionConstraint *constraints;
+	int			count = 0;
+	int			nconstraints = 0;
+	WhitelistNames *result;
+
+	if (!SplitIdentifierString(rawnames, ',', &extensions))
+	{
+		/* syntax error in extension name list */
+		GUC_check_errdetail("List syntax is invalid.");
+		pfree(rawnames);
+		list_free(extensions);
+		return false;
+	}
+
+	if (list_item_is_too_long(*newval))
+	{
+		GUC_check_errdetail("List items must be shorter than %d bytes.",
+							NAMEDATALEN);
+		pfree(rawnames);
+		list_free(extensions);
+		return false;
+	}
+
+	names = (WhitelistName *)
+		palloc0(Max(list_length(extensions), 1) * sizeof(WhitelistName));
+	constraints = (VersionConstraint *)
+		palloc0(Max(list_length(extensions), 1) * sizeof(VersionConstraint));
+
+	/* none of the items was truncated, see list_item_is_too_long() */
+	foreach(lc, extensions)
+	{
+		char	   *item = (char *) lfirst(lc);
+		char	   *op;
+		const char *error;
+
+		if (is_version_constraint_start(item[0]))
+		{
+			/* another constraint for the previous name */
+			if (count == 0)
+			{
+				GUC_check_errdetail("Version constraint \"%s\" has no extension name.",
+									item);
+				goto fail;
+			}
+			op = item;
+		}
+		else
+		{
+			WhitelistName *entry = &names[count++];
+			char		save;
+
+			for (op = item; *op && !is_version_constraint_start(*op); op++)
+				;
+
+			save = *op;
+			*op = '\0';
+			namestrcpy(&entry->name, item);
+			*op = save;
+
+			entry->first_constraint = nconstraints;
+			entry->nconstraints = 0;
+
+			if (*op == '\0')
+				continue;
+		}
+
+		if ((error = parse_version_constraint(op, &constraints[nconstraints])) != NULL)
+		{
+			GUC_check_errdetail("Invalid version constraint \"%s\": %s",
+								op, error);
+			goto fail;
+		}
+		nconstraints++;
+		names[count - 1].nconstraints++;
+	}
+
+	result = (WhitelistNames *)
+		malloc(WhitelistConstraintsOffset(count)
+			   + nconstraints * sizeof(VersionConstraint));
+
+	if (result == NULL)
+	{
+		GUC_check_errcode(ERRCODE_OUT_OF_MEMORY);
+		GUC_check_errmsg("out of memory");
+		goto fail;
+	}
+
+	result->count = count;
+	result->nconstraints = nconstraints;
+	memcpy(result->names, names, count * sizeof(WhitelistName));
+	memcpy(WhitelistConstraints(result), constraints,
+		   nconstraints * sizeof(VersionConstraint));
+
+	pfree(names);
+	pfree(constraints);
+	pfree(rawnames);
+	list_free(extensions);
+
+	*extra = result;
+	return true;
+
+fail:
+	pfree(names);
+	pfree(constraints);
+	pfree(rawnames);
+	list_free(extensions);
+	return false;
+}
+
+/*
+ * GUC assign_hook for extwlist.extensions
+ */
+void
+assign_extwlist_extensions(const char *newval, void *extra)
+{
+	whitelist_names = (WhitelistNames *) extra;
+	whitelist_valid = false;
+}
+
+static TrieNode *
+new_trie_node(Whitelist *wl, char label, bool is_star)
+{
+	TrieNode   *node = &wl->nodes[wl->nnodes++];
+
+	node->label = label;
+	node->is_star = is_star;
+	node->accept = -1;
+	return node;
+}
+
+/*
+ * Add the name or pattern of the given list entry to the trie.
+ */
+static void
+add_trie_pattern(Whitelist *wl, int entry)
+{
+	const char *pattern = NameStr(wl->names->names[entry].name);
+	TrieNode   *node = &wl->nodes[0];
+	const char *p;
+
+	for (p = pattern; *p; p++)
+	{
+		TrieNode   *child;
+
+		switch (*p)
+		{
+			case '*':
+				/* "**" is the same as "*" */
+				if (node->is_star)
+					continue;
+				if (node->star == NULL)
+					node->star = new_trie_node(wl, *p, true);
+				node = node->star;
+				break;
+
+			case '?':
+				if (node->any == NULL)
+					node->any = new_trie_node(wl, *p, false);
+				node = node->any;
+				break;
+
+			default:
+				for (child = node->children; child; child = child->next)
+					if (child->label == *p)
+						break;
+
+				if (child == NULL)
+				{
+					child = new_trie_node(wl, *p, false);
+					child->next = node->children;
+					node->children = child;
+				}
+				node = child;
+				break;
+		}
+	}
+	wl->next_accept[entry] = node->accept;
+	node->accept = entry;
+}
+
+/*
+ * Build the trie from the current check hook output.
+ */
+static void
+build_whitelist(void)
+{
+	MemoryContext context;
+	MemoryContext oldcontext;
+	Whitelist  *wl;
+	int			maxnodes = 1;
+	int			i;
+
+	if (whitelist)
+	{
+		MemoryContextDelete(whitelist->context);
+		whitelist = NULL;
+	}
+
+	if (whitelist_names == NULL || whitelist_names->count == 0)
+	{
+		whitelist_valid = true;
+		return;
+	}
+
+	/* each character of each name adds at most one node */
+	for (i = 0; i < whitelist_names->count; i++)
+		maxnodes += strlen(NameStr(whitelist_names->names[i].name));
+
+	context = AllocSetContextCreate(TopMemoryContext,
+									"pgextwlist whitelist",
+									ALLOCSET_SMALL_SIZES);
+	oldcontext = MemoryContextSwitchTo(context);
+
+	wl = (Whitelist *) palloc0(sizeof(Whitelist));
+	wl->context = context;
+	wl->nodes = (TrieNode *) palloc0(maxnodes * sizeof(TrieNode));
+	wl->active = (TrieNode **) palloc(maxnodes * sizeof(TrieNode *));
+	wl->next = (TrieNode **) palloc(maxnodes * sizeof(TrieNode *));
+	wl->names = whitelist_names;
+	wl->next_accept = (int *) palloc(whitelist_names->count * sizeof(int));
+
+	(void) new_trie_node(wl, '\0', false);
+
+	for (i = 0; i < whitelist_names->count; i++)
+		add_trie_pattern(wl, i);
+
+	MemoryContextSwitchTo(oldcontext);
+
+	whitelist = wl;
+	whitelist_valid = true;
+}
+
+/*
+ * Start a new set of active nodes.  Marks from before a wraparound could be
+ * mistaken for current ones, so reset them then.
+ */
+static inline void
+next_lookup_step(Whitelist *wl)
+{
+	int			i;
+
+	if (++wl->step != 0)
+		return;
+
+	for (i = 0; i < wl->nnodes; i++)
+		wl->nodes[i].mark = 0;
+	wl->step = 1;
+}
+
+/*
+ * Add a node to a set of active nodes, unless it's already there, along with
+ * the node reached from it with '*', which matches the empty string too.
+ */
+static inline int
+add_active_node(Whitelist *wl, TrieNode **set, int n, TrieNode *node)
+{
+	if (node->mark != wl->step)
+	{
+		node->mark = wl->step;
+		set[n++] = node;
+	}
+	if (node->star && node->star->mark != wl->step)
+	{
+		node->star->mark = wl->step;
+		set[n++] = node->star;
+	}
+	return n;
+}
+
+/*
+ * Cheap test used by the ProcessUtility hook to pass through as soon as
+ * possible when nothing has been whitelisted.  This must be called in a
+ * transaction, for the extwlist.allowed table.
+ */
+bool
+whitelist_is_empty(void)
+{
+	return (whitelist_names == NULL || whitelist_names->count == 0)
+		&& !whitelist_file_is_set()
+		&& allowed_table_is_empty();
+}
+
+/*
+ * Does the version satisfy all the constraints of the entry?  Entries with
+ * constraints don't allow an unknown version.
+ */
+static bool
+entry_allows_version(const WhitelistNames *names, const WhitelistName *entry,
+					 const char *version)
+{
+	const VersionConstraint *constraints = WhitelistConstraints(names);
+	int			i;
+
+	for (i = 0; i < entry->nconstraints; i++)
+		if (version == NULL
+			|| !version_satisfies(version,
+								  &constraints[entry->first_constraint + i]))
+			return false;
+
+	return true;
+}
+
+/*
+ * Does the name match one of the extwlist.extensions entries, and when asked
+ * to, does the version satisfy its constraints?
+ */
+static bool
+whitelist_matches(const char *name, const char *version, bool check_version)
+{
+	Whitelist  *wl;
+	const char *c;
+	int			nactive;
+	int			i;
+
+	if (!whitelist_valid)
+		build_whitelist();
+
+	if (whitelist == NULL)
+		return false;
+
+	wl = whitelist;
+
+	next_lookup_step(wl);
+	nactive = add_active_node(wl, wl->active, 0, &wl->nodes[0]);
+
+	for (c = name; *c && nactive > 0; c++)
+	{
+		TrieNode  **swap;
+		int			nnext = 0;
+
+		next_lookup_step(wl);
+
+		for (i = 0; i < nactive; i++)
+		{
+			TrieNode   *node = wl->active[i];
+			TrieNode   *child;
+
+			if (node->is_star)
+				nnext = add_active_node(wl, wl->next, nnext, node);
+			if (node->any)
+				nnext = add_active_node(wl, wl->next, nnext, node->any);
+
+			for (child = node->children; child; child = child->next)
+				if (child->label == *c)
+				{
+					nnext = add_active_node(wl, wl->next, nnext, child);
+					break;
+				}
+		}
+
+		swap = wl->active;
+		wl->active = wl->next;
+		wl->next = swap;
+		nactive = nnext;
+	}
+
+	/* several entries may match, as in "hstore=1.7, h*re>=1.8" */
+	for (i = 0; i < nactive; i++)
+	{
+		int			entry;
+
+		for (entry = wl->active[i]->accept; entry >= 0;
+			 entry = wl->next_accept[entry])
+			if (!check_version
+				|| entry_allows_version(wl->names, &wl->names->names[entry],
+										version))
+				return true;
+	}
+
+	return false;
+}
+
+/*
+ * Is the extension whitelisted, whatever its version?
+ */
+bool
+extension_is_whitelisted(const char *name)
+{
+	return whitelist_matches(name, NULL, false)
+		|| whitelist_file_contains(name)
+		|| allowed_table_contains(name, GetUserId());
+}
+
+/*
+ * Is given version of the extension whitelisted?  The extwlist.allowed table
+ * has no version constraints, and allows every version.
+ */
+bool
+extension_version_is_whitelisted(const char *name, const char *version)
+{
+	return whitelist_matches(name, version, true)
+		|| whitelist_file_allows_version(name, version)
+		|| allowed_table_contains(name, GetUserId());
+}
@@ -0,0 +1,23 @@
+/* PostgreSQL Extension WhiteList -- Dimitri Fontaine
+ *
+ * Author: Dimitri Fontaine <dimitri@2ndQuadrant.fr>
+ * Licence: PostgreSQL
+ * Copyright Dimitri Fontaine, 2011-2013
+ *
+ * For a description of the features see the README.md file from the same
+ * distribution.
+ */
+
+#ifndef __WHITELIST_H__
+#define __WHITELIST_H__
+
+#include "utils/guc.h"
+
+bool check_extwlist_extensions(char **newval, void **extra, GucSource source);
+void assign_extwlist_extensions(const char *newval, void *extra);
+
+bool whitelist_is_empty(void);
+bool extension_is_whitelisted(const char *name);
+bool extension_version_is_whitelisted(const char *name, const char *version);
+
+#endif
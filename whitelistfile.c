@@ -0,0 +1,628 @@
+/* PostgreSQL Extension WhiteList -- Dimitri Fontaine
+ *
+ * Author: Dimitri Fontaine <dimitri@2ndQuadrant.fr>
+ * Licence: PostgreSQL
+ * Copyright Dimitri Fontaine, 2011-2013
+ *
+ * For a description of the features see the README.md file from the same
+ * distribution.
+ */
+
+/*
+ * Whitelist read from the file given by extwlist.extensions_file, for lists
+ * too long to be maintained in a setting.
+ *
+ * The file is a plain text list of extension names, one per line, each
+ * optionally followed by version constraints as in extwlist.extensions,
+ * such as "postgis>=3.3,<4".  We compile it into a binary index: a header,
+ * the entries sorted by name, and their compiled constraints, see version.c.
+ * The index lives in the data directory, and each backend maps it
+ * read-only, so that they all share the same pages, and looks names up with
+ * a binary search, which doesn't allocate anything.
+ *
+ * The index records the size and a checksum of the file it was compiled
+ * from: modification times are too coarse to tell about a quick edit that
+ * keeps the size.  When the setting is reloaded, on SIGHUP, backends read
+ * the file again and the first one to find the index stale compiles it
+ * again, into a temporary file that is then renamed over the old index.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef WIN32
+#include <sys/mman.h>
+#endif
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "postgres.h"
+
+#include "pgextwlist.h"
+#include "version.h"
+#include "whitelistfile.h"
+
+#include "miscadmin.h"
+#include "port/pg_crc32c.h"
+#include "storage/fd.h"
+#include "utils/builtins.h"
+#include "utils/memutils.h"
+
+#define WHITELIST_INDEX_FILE	"pgextwlist.idx"
+#define WHITELIST_INDEX_MAGIC	0x4C575845	/* "EXWL" */
+#define WHITELIST_INDEX_VERSION	2
+
+typedef struct WhitelistIndexHeader
+{
+	uint32		magic;
+	uint32		version;
+	int64		source_size;
+	pg_crc32c	source_crc;
+	uint32		count;			/* entries following the header */
+	uint32		nconstraints;	/* constraints following the entries */
+	char		source[MAXPGPATH];	/* file we were compiled from */
+} WhitelistIndexHeader;
+
+/*
+ * An extension name and its constraints, all of which must be satisfied.
+ * Names listed more than once have an entry per line, any of which allows
+ * the extension.
+ */
+typedef struct WhitelistIndexEntry
+{
+	NameData	name;
+	uint32		first_constraint;
+	uint32		nconstraints;
+} WhitelistIndexEntry;
+
+#define IndexEntriesOffset() \
+	MAXALIGN(sizeof(WhitelistIndexHeader))
+#define IndexConstraintsOffset(count) \
+	MAXALIGN(IndexEntriesOffset() + (count) * sizeof(WhitelistIndexEntry))
+#define IndexSize(count, nconstraints) \
+	(IndexConstraintsOffset(count) + (nconstraints) * sizeof(VersionConstraint))
+
+#define IndexEntries(data) \
+	((const WhitelistIndexEntry *) ((data) + IndexEntriesOffset()))
+#define IndexConstraints(data, count) \
+	((const VersionConstraint *) ((data) + IndexConstraintsOffset(count)))
+
+/* the source file, as read when checking the index */
+typedef struct WhitelistSource
+{
+	char	   *data;
+	size_t		len;
+	pg_crc32c	crc;
+} WhitelistSource;
+
+char	   *extwlist_extensions_file = NULL;
+
+/* the index currently mapped, if any */
+static char *index_data = NULL;
+static size_t index_len = 0;
+static bool index_mmapped = false;
+
+/* check the file again at next lookup */
+static bool index_stale = true;
+
+/*
+ * GUC assign_hook for extwlist.extensions_file
+ *
+ * Called again for each SIGHUP, whether the setting changed or not, which is
+ * when we check whether the file itself changed.
+ */
+void
+assign_extwlist_extensions_file(const char *newval, void *extra)
+{
+	index_stale = true;
+}
+
+bool
+whitelist_file_is_set(void)
+{
+	return extwlist_extensions_file != NULL && extwlist_extensions_file[0] != '\0';
+}
+
+static void
+unmap_whitelist_index(void)
+{
+	if (index_data == NULL)
+		return;
+
+#ifndef WIN32
+	if (index_mmapped)
+		(void) munmap(index_data, index_len);
+	else
+#endif
+		pfree(index_data);
+
+	index_data = NULL;
+	index_len = 0;
+	index_mmapped = false;
+}
+
+static int
+compare_names(const void *a, const void *b)
+{
+	return strncmp((const char *) a, (const char *) b, NAMEDATALEN);
+}
+
+/*
+ * Read the whole source file, and compute its checksum.
+ */
+static void
+read_whitelist_source(const char *source, WhitelistSource *src)
+{
+	FILE	   *file;
+	struct stat st;
+
+	if ((file = AllocateFile(source, "r")) == NULL)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not open file \"%s\" for reading: %m", source)));
+
+	if (fstat(fileno(file), &st) < 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not stat file \"%s\": %m", source)));
+
+	src->data = (char *) palloc((Size) st.st_size + 1);
+	src->len = fread(src->data, 1, (size_t) st.st_size, file);
+
+	if (ferror(file))
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not read file \"%s\": %m", source)));
+
+	FreeFile(file);
+
+	src->data[src->len] = '\0';
+
+	INIT_CRC32C(src->crc);
+	COMP_CRC32C(src->crc, src->data, src->len);
+	FIN_CRC32C(src->crc);
+}
+
+/*
+ * Parse one line of the source file, already stripped of its comment and
+ * blanks, into an entry and its constraints.
+ */
+static void
+parse_whitelist_line(const char *source, int lineno, char *line,
+					 WhitelistIndexEntry *entry,
+					 VersionConstraint **constraints,
+					 int *nconstraints, int *maxconstraints)
+{
+	char	   *p = line;
+
+	while (*p && !is_version_constraint_start(*p)
+		   && *p != ',' && !isspace((unsigned char) *p))
+		p++;
+
+	if (p == line)
+		ereport(ERROR,
+				(errcode(ERRCODE_CONFIG_FILE_ERROR),
+				 errmsg("missing extension name at line %d of file \"%s\"",
+						lineno, source)));
+
+	if (p - line >= NAMEDATALEN)
+		ereport(ERROR,
+				(errcode(ERRCODE_NAME_TOO_LONG),
+				 errmsg("extension name too long at line %d of file \"%s\"",
+						lineno, source)));
+
+	MemSet(entry, 0, sizeof(WhitelistIndexEntry));
+	memcpy(NameStr(entry->name), line, p - line);
+	entry->first_constraint = *nconstraints;
+	entry->nconstraints = 0;
+
+	/* the constraints, separated by commas, as in "postgis >= 3.3, < 4" */
+	while (*p)
+	{
+		char		item[NAMEDATALEN * 2];
+		char	   *start;
+		char	   *end;
+		const char *error;
+		int			len = 0;
+
+		while (isspace((unsigned char) *p) || *p == ',')
+			p++;
+		if (*p == '\0')
+			break;
+
+		start = p;
+		while (*p && *p != ',')
+			p++;
+		end = p;
+		while (end > start && isspace((unsigned char) end[-1]))
+			end--;
+
+		/* blanks between the operator and the version don't count */
+		for (; start < end; start++)
+		{
+			if (isspace((unsigned char) *start))
+				continue;
+			if (len >= (int) sizeof(item) - 1)
+				ereport(ERROR,
+						(errcode(ERRCODE_CONFIG_FILE_ERROR),
+						 errmsg("version constraint too long at line %d of file \"%s\"",
+								lineno, source)));
+			item[len++] = *start;
+		}
+		item[len] = '\0';
+
+		if (*nconstraints == *maxconstraints)
+		{
+			*maxconstraints *= 2;
+			*constraints = (VersionConstraint *)
+				repalloc(*constraints, *maxconstraints * sizeof(VersionConstraint));
+		}
+
+		if ((error = parse_version_constraint(item, &(*constraints)[*nconstraints])) != NULL)
+			ereport(ERROR,
+					(errcode(ERRCODE_CONFIG_FILE_ERROR),
+					 errmsg("invalid version constraint \"%s\" at line %d of file \"%s\"",
+							item, lineno, source),
+					 errdetail("%s", error)));
+
+		(*nconstraints)++;
+		entry->nconstraints++;
+	}
+}
+
+/*
+ * Compile the source file into the index.
+ */
+static void
+compile_whitelist_index(const char *source, const WhitelistSource *src)
+{
+	FILE	   *file;
+	char	   *text = pstrdup(src->data);
+	char	   *line;
+	char	   *next;
+	int			lineno = 0;
+	WhitelistIndexEntry *entries;
+	VersionConstraint *constraints;
+	VersionConstraint *sorted_constraints;
+	int			count = 0;
+	int			size = 64;
+	int			nconstraints = 0;
+	int			maxconstraints = 64;
+	int			i;
+	uint32		pos;
+	WhitelistIndexHeader header;
+	char		tmpname[MAXPGPATH];
+	static const char padding[MAXIMUM_ALIGNOF];
+
+	entries = (WhitelistIndexEntry *) palloc(size * sizeof(WhitelistIndexEntry));
+	constraints = (VersionConstraint *)
+		palloc(maxconstraints * sizeof(VersionConstraint));
+
+	for (line = text; line != NULL; line = next)
+	{
+		char	   *end;
+
+		lineno++;
+
+		if ((next = strchr(line, '\n')) != NULL)
+			*next++ = '\0';
+
+		/* skip comments and blanks around the entry */
+		if ((end = strchr(line, '#')) != NULL)
+			*end = '\0';
+		while (*line && isspace((unsigned char) *line))
+			line++;
+		end = line + strlen(line);
+		while (end > line && isspace((unsigned char) end[-1]))
+			*--end = '\0';
+
+		if (*line == '\0')
+			continue;
+
+		if (count == size)
+		{
+			size *= 2;
+			entries = (WhitelistIndexEntry *)
+				repalloc(entries, size * sizeof(WhitelistIndexEntry));
+		}
+
+		parse_whitelist_line(source, lineno, line, &entries[count],
+							 &constraints, &nconstraints, &maxconstraints);
+		count++;
+	}
+
+	/* entries start with their name, sort them by name */
+	qsort(entries, count, sizeof(WhitelistIndexEntry), compare_names);
+
+	/* and renumber the constraints in the same order */
+	sorted_constraints = (VersionConstraint *)
+		palloc(Max(nconstraints, 1) * sizeof(VersionConstraint));
+
+	for (i = 0, pos = 0; i < count; i++)
+	{
+		memcpy(&sorted_constraints[pos],
+			   &constraints[entries[i].first_constraint],
+			   entries[i].nconstraints * sizeof(VersionConstraint));
+		entries[i].first_constraint = pos;
+		pos += entries[i].nconstraints;
+	}
+
+	MemSet(&header, 0, sizeof(header));
+	header.magic = WHITELIST_INDEX_MAGIC;
+	header.version = WHITELIST_INDEX_VERSION;
+	header.source_size = (int64) src->len;
+	header.source_crc = src->crc;
+	header.count = count;
+	header.nconstraints = nconstraints;
+	strlcpy(header.source, source, MAXPGPATH);
+
+	/* concurrent compilers each write their own copy */
+	snprintf(tmpname, MAXPGPATH, "%s.%d", WHITELIST_INDEX_FILE, MyProcPid);
+
+	if ((file = AllocateFile(tmpname, PG_BINARY_W)) == NULL)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not create file \"%s\": %m", tmpname)));
+
+	if (fwrite(&header, sizeof(header), 1, file) != 1
+		|| fwrite(padding, 1, IndexEntriesOffset() - sizeof(header), file)
+		!= IndexEntriesOffset() - sizeof(header)
+		|| (count > 0
+			&& fwrite(entries, sizeof(WhitelistIndexEntry), count, file) != (size_t) count)
+		|| fwrite(padding, 1,
+				  IndexConstraintsOffset(count) - IndexEntriesOffset()
+				  - count * sizeof(WhitelistIndexEntry), file)
+		!= IndexConstraintsOffset(count) - IndexEntriesOffset()
+		- count * sizeof(WhitelistIndexEntry)
+		|| (nconstraints > 0
+			&& fwrite(sorted_constraints, sizeof(VersionConstraint), nconstraints,
+					  file) != (size_t) nconstraints)
+		|| FreeFile(file) != 0)
+	{
+		int			save_errno = errno;
+
+		(void) unlink(tmpname);
+		errno = save_errno;
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not write file \"%s\": %m", tmpname)));
+	}
+
+	if (rename(tmpname, WHITELIST_INDEX_FILE) != 0)
+	{
+		int			save_errno = errno;
+
+		(void) unlink(tmpname);
+		errno = save_errno;
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not rename file \"%s\" to \"%s\": %m",
+						tmpname, WHITELIST_INDEX_FILE)));
+	}
+
+	pfree(sorted_constraints);
+	pfree(constraints);
+	pfree(entries);
+	pfree(text);
+}
+
+/*
+ * Is the mapped index the one of given source file?
+ */
+static bool
+index_is_current(const char *source, const WhitelistSource *src)
+{
+	const WhitelistIndexHeader *header =
+		(const WhitelistIndexHeader *) index_data;
+
+	return header->source_size == (int64) src->len
+		&& EQ_CRC32C(header->source_crc, src->crc)
+		&& strncmp(header->source, source, MAXPGPATH) == 0;
+}
+
+/*
+ * Map the index, and tell whether it is up to date with the source file.
+ */
+static bool
+map_whitelist_index(const char *source, const WhitelistSource *src)
+{
+	FILE	   *file;
+	struct stat ist;
+	const WhitelistIndexHeader *header;
+
+	unmap_whitelist_index();
+
+	if ((file = AllocateFile(WHITELIST_INDEX_FILE, PG_BINARY_R)) == NULL)
+	{
+		if (errno == ENOENT)
+			return false;
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not open file \"%s\" for reading: %m",
+						WHITELIST_INDEX_FILE)));
+	}
+
+	if (fstat(fileno(file), &ist) < 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not stat file \"%s\": %m", WHITELIST_INDEX_FILE)));
+
+	if ((size_t) ist.st_size < sizeof(WhitelistIndexHeader))
+	{
+		FreeFile(file);
+		return false;
+	}
+
+#ifndef WIN32
+	{
+		void	   *addr = mmap(NULL, (size_t) ist.st_size, PROT_READ,
+								MAP_SHARED, fileno(file), 0);
+
+		if (addr != MAP_FAILED)
+		{
+			index_data = (char *) addr;
+			index_len = (size_t) ist.st_size;
+			index_mmapped = true;
+		}
+	}
+#endif
+
+	if (index_data == NULL)
+	{
+		char	   *content = MemoryContextAlloc(TopMemoryContext,
+												 (Size) ist.st_size);
+
+		if (fread(content, 1, (size_t) ist.st_size, file) != (size_t) ist.st_size)
+		{
+			pfree(content);
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not read file \"%s\": %m",
+							WHITELIST_INDEX_FILE)));
+		}
+		index_data = content;
+		index_len = (size_t) ist.st_size;
+	}
+
+	FreeFile(file);
+
+	header = (const WhitelistIndexHeader *) index_data;
+
+	if (header->magic != WHITELIST_INDEX_MAGIC
+		|| header->version != WHITELIST_INDEX_VERSION
+		|| !index_is_current(source, src)
+		|| index_len != IndexSize(header->count, header->nconstraints))
+	{
+		unmap_whitelist_index();
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Make sure we have an up to date index mapped, when the file changed.
+ */
+static void
+refresh_whitelist_index(void)
+{
+	const char *source = extwlist_extensions_file;
+	WhitelistSource src;
+
+	if (!index_stale)
+		return;
+
+	if (!whitelist_file_is_set())
+	{
+		unmap_whitelist_index();
+		index_stale = false;
+		return;
+	}
+
+	read_whitelist_source(source, &src);
+
+	if (index_data == NULL || !index_is_current(source, &src))
+	{
+		if (!map_whitelist_index(source, &src))
+		{
+			compile_whitelist_index(source, &src);
+
+			if (!map_whitelist_index(source, &src))
+				ereport(ERROR,
+						(errcode(ERRCODE_DATA_CORRUPTED),
+						 errmsg("invalid whitelist index \"%s\"",
+								WHITELIST_INDEX_FILE)));
+		}
+	}
+
+	pfree(src.data);
+	index_stale = false;
+}
+
+/*
+ * Does the entry allow given version?  Entries with constraints don't allow
+ * an unknown version.
+ */
+static bool
+index_entry_allows_version(const WhitelistIndexEntry *entry,
+						   const VersionConstraint *constraints,
+						   const char *version)
+{
+	uint32		i;
+
+	for (i = 0; i < entry->nconstraints; i++)
+		if (version == NULL
+			|| !version_satisfies(version,
+								  &constraints[entry->first_constraint + i]))
+			return false;
+
+	return true;
+}
+
+/*
+ * Is the extension listed in extwlist.extensions_file, and when asked to, in
+ * given version?
+ */
+static bool
+whitelist_file_matches(const char *name, const char *version,
+					   bool check_version)
+{
+	const WhitelistIndexHeader *header;
+	const WhitelistIndexEntry *entries;
+	const WhitelistIndexEntry *found;
+	const VersionConstraint *constraints;
+	NameData	key;
+	int			first;
+	int			i;
+
+	if (!whitelist_file_is_set())
+		return false;
+
+	refresh_whitelist_index();
+
+	if (index_data == NULL)
+		return false;
+
+	header = (const WhitelistIndexHeader *) index_data;
+	entries = IndexEntries(index_data);
+	constraints = IndexConstraints(index_data, header->count);
+
+	/* the index has NAMEDATALEN bytes for each name */
+	MemSet(&key, 0, sizeof(key));
+	strlcpy(NameStr(key), name, NAMEDATALEN);
+
+	found = bsearch(&key, entries, header->count,
+					sizeof(WhitelistIndexEntry), compare_names);
+
+	if (found == NULL)
+		return false;
+
+	if (!check_version)
+		return true;
+
+	/* the name may be listed more than once, any entry will do */
+	for (first = found - entries;
+		 first > 0 && compare_names(&entries[first - 1], &key) == 0;
+		 first--)
+		;
+
+	for (i = first;
+		 i < (int) header->count && compare_names(&entries[i], &key) == 0;
+		 i++)
+		if (index_entry_allows_version(&entries[i], constraints, version))
+			return true;
+
+	return false;
+}
+
+bool
+whitelist_file_contains(const char *name)
+{
+	return whitelist_file_matches(name, NULL, false);
+}
+
+bool
+whitelist_file_allows_version(const char *name, const char *version)
+{
+	return whitelist_file_matches(name, version, true);
+}
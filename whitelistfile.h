@@ -0,0 +1,22 @@
+/* PostgreSQL Extension WhiteList -- Dimitri Fontaine
+ *
+ * Author: Dimitri Fontaine <dimitri@2ndQuadrant.fr>
+ * Licence: PostgreSQL
+ * Copyright Dimitri Fontaine, 2011-2013
+ *
+ * For a description of the features see the README.md file from the same
+ * distribution.
+ */
+
+#ifndef __WHITELISTFILE_H__
+#define __WHITELISTFILE_H__
+
+extern char *extwlist_extensions_file;
+
+void assign_extwlist_extensions_file(const char *newval, void *extra);
+
+bool whitelist_file_is_set(void);
+bool whitelist_file_contains(const char *name);
+bool whitelist_file_allows_version(const char *name, const char *version);
+
+#endif